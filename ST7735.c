@@ -23,6 +23,8 @@
 //     described in your existing Nokia5110.h
 //  2. Please note that all other hardware interfaces e.g. sound, buttons, leds, slide pot etc.
 //     are not implemented by this software
+//  3. Optional features are selected by defining the NOKIA5110EMU_ options listed
+//     below the #include lines as 1 on the compiler command line
 //
 //============================================================================
 //   TM4C123G Launchpad pin usage
@@ -62,6 +64,264 @@
 #include <stdint.h>
 #include "../inc/tm4c123gh6pm.h"
 
+// Emulator options
+// NOKIA5110EMU_DMA  Stream pixel data to SSI2 with uDMA channel 13 so drawing
+//                   functions return before the transfer has finished.
+//                   Requires SSI2_Handler in the startup file vector table
+#ifndef NOKIA5110EMU_DMA
+  #define NOKIA5110EMU_DMA 0
+#endif
+// NOKIA5110EMU_DOUBLE_BUFFER  Add a front buffer behind Screen so a new frame
+//                   can be flipped while the last is still streaming by uDMA.
+//                   Requires NOKIA5110EMU_DMA
+#ifndef NOKIA5110EMU_DOUBLE_BUFFER
+  #define NOKIA5110EMU_DOUBLE_BUFFER 0
+#endif
+// NOKIA5110EMU_GLYPH_ATLAS  Build a copy of the font in flash already packed as
+//                   12-bit pixel data (6912 bytes) so characters are copied
+//                   straight to the SSI without being expanded
+#ifndef NOKIA5110EMU_GLYPH_ATLAS
+  #define NOKIA5110EMU_GLYPH_ATLAS 0
+#endif
+// NOKIA5110EMU_SSI_12BIT  Send pixel data with SSI2 in 12-bit frame mode so each
+//                   pixel is one write to the FIFO, commands stay 8-bit
+#ifndef NOKIA5110EMU_SSI_12BIT
+  #define NOKIA5110EMU_SSI_12BIT 0
+#endif
+// NOKIA5110EMU_ASYNC_INIT  Return from Nokia5110Emu_Init straight away and bring
+//                   the ST7735 up from the Timer5A interrupt. Drawing before
+//                   the LCD is ready only updates the shadow copy, which is
+//                   shown once it is. Requires Timer5A_Handler in the startup
+//                   file vector table
+#ifndef NOKIA5110EMU_ASYNC_INIT
+  #define NOKIA5110EMU_ASYNC_INIT 0
+#endif
+// NOKIA5110EMU_FAST_BOOT  0 fills the ST7735 around the emulator window with an
+//                   RGB test pattern, 1 fills it with PIXEL_BORDER in one burst
+//                   per side, 2 leaves it as it is and draws no labels
+#ifndef NOKIA5110EMU_FAST_BOOT
+  #define NOKIA5110EMU_FAST_BOOT 0
+#endif
+// NOKIA5110EMU_TX_QUEUE  Queue commands and pixel data for the SSI2 transmit
+//                   interrupt to send, so drawing functions only wait when the
+//                   queue is full. Requires SSI2_Handler in the startup file
+//                   vector table, cannot be used with NOKIA5110EMU_DMA
+#ifndef NOKIA5110EMU_TX_QUEUE
+  #define NOKIA5110EMU_TX_QUEUE 0
+#endif
+// NOKIA5110EMU_TXQ_SIZE  Entries in the transmit queue, must be a power of 2
+#ifndef NOKIA5110EMU_TXQ_SIZE
+  #define NOKIA5110EMU_TXQ_SIZE 256
+#endif
+// NOKIA5110EMU_SERVER  Add Nokia5110Emu_Post functions which any RTOS thread can
+//                   call to queue text, clears and frames for one display
+//                   server thread, Nokia5110Emu_ServerThread, to draw. Needs
+//                   StartCritical/EndCritical and OS_Suspend from the RTOS
+#ifndef NOKIA5110EMU_SERVER
+  #define NOKIA5110EMU_SERVER 0
+#endif
+// NOKIA5110EMU_SERVER_SLOTS  Requests the display server can hold, a power of 2
+#ifndef NOKIA5110EMU_SERVER_SLOTS
+  #define NOKIA5110EMU_SERVER_SLOTS 16
+#endif
+// NOKIA5110EMU_SERVER_IDLE  What the display server does when it has nothing to do
+#ifndef NOKIA5110EMU_SERVER_IDLE
+  #define NOKIA5110EMU_SERVER_IDLE() OS_Suspend()
+#endif
+// NOKIA5110EMU_SCROLL  Scroll the emulator window up one text row with the
+//                   ST7735 hardware scroll when text wraps past the last row
+//                   instead of going back to the top, so a new line only sends
+//                   one 84x8 row. The ST7735 either side of the window scrolls
+//                   too so it is filled with PIXEL_BORDER
+#ifndef NOKIA5110EMU_SCROLL
+  #define NOKIA5110EMU_SCROLL 0
+#endif
+// NOKIA5110EMU_FRAME_PACING  Add Nokia5110Emu_Present which holds on to the
+//                   latest frame and lets Timer5A send it at most once per
+//                   panel frame, see Nokia5110Emu_SetFrameRate. Requires
+//                   Timer5A_Handler in the startup file vector table
+#ifndef NOKIA5110EMU_FRAME_PACING
+  #define NOKIA5110EMU_FRAME_PACING 0
+#endif
+// NOKIA5110EMU_SPRITES  Add Nokia5110Emu_ConvertBMP which converts a BMP image
+//                   for Nokia5110_PrintBMP once into a bank aligned sprite
+//                   and Nokia5110Emu_DrawSprite which draws it into Screen a
+//                   whole byte at a time
+#ifndef NOKIA5110EMU_SPRITES
+  #define NOKIA5110EMU_SPRITES 0
+#endif
+// NOKIA5110EMU_RASTER  Add raster operations on Screen which work on whole
+//                   32-bit words of each bank: filled and inverted rectangles,
+//                   scrolling the buffer and copying through a mask
+#ifndef NOKIA5110EMU_RASTER
+  #define NOKIA5110EMU_RASTER 0
+#endif
+// NOKIA5110EMU_BUFFERED_TEXT  Make Nokia5110_OutChar, Nokia5110_OutString and the
+//                   number formatters draw into Screen like Nokia5110_PrintBMP,
+//                   and Nokia5110_Clear clear Screen, so text and images reach
+//                   the LCD together on the next Nokia5110_DisplayBuffer
+#ifndef NOKIA5110EMU_BUFFERED_TEXT
+  #define NOKIA5110EMU_BUFFERED_TEXT 0
+#endif
+// NOKIA5110EMU_PCD8544  Add Nokia5110Emu_PCD8544Write which takes the command and
+//                   data bytes code written for the real PCD8544 sends, keeps
+//                   its address counter and sends the columns written to the
+//                   ST7735 at the end of each transaction
+#ifndef NOKIA5110EMU_PCD8544
+  #define NOKIA5110EMU_PCD8544 0
+#endif
+// NOKIA5110EMU_NATIVE_FRAMES  Add Nokia5110Emu_DrawNative and Nokia5110Emu_PlayNative
+//                   which send frames already packed as 12-bit pixels, made
+//                   by tools/native_frames.c, straight from flash to the LCD
+#ifndef NOKIA5110EMU_NATIVE_FRAMES
+  #define NOKIA5110EMU_NATIVE_FRAMES 0
+#endif
+// NOKIA5110EMU_DELTA_FRAMES  Add Nokia5110Emu_DecodeDelta and Nokia5110Emu_DrawDelta
+//                   which play animations compressed by tools/delta_frames.c
+//                   as run length coded XOR differences between frames
+#ifndef NOKIA5110EMU_DELTA_FRAMES
+  #define NOKIA5110EMU_DELTA_FRAMES 0
+#endif
+// NOKIA5110EMU_POWER_SAVE  Add Nokia5110Emu_SetPowerSave which can put the ST7735
+//                   in 8-colour idle mode, only scan the rows of the emulator
+//                   window and send it to sleep after a time without drawing.
+//                   Requires Timer5A_Handler in the startup file vector table
+#ifndef NOKIA5110EMU_POWER_SAVE
+  #define NOKIA5110EMU_POWER_SAVE 0
+#endif
+// NOKIA5110EMU_UPSCALE  Show each Nokia5110 pixel bigger: 0 at 1x in an 84x48
+//                   window, 1 at 1.5x in a 126x72 window, 2 at 1.5x across
+//                   and 2x down in a 126x96 window. Pixels are stretched as
+//                   they are sent so nothing extra is kept in RAM. Cannot be
+//                   used with NOKIA5110EMU_SCROLL or NOKIA5110EMU_NATIVE_FRAMES
+#ifndef NOKIA5110EMU_UPSCALE
+  #define NOKIA5110EMU_UPSCALE 0
+#endif
+// NOKIA5110EMU_DISPLAYS  Number of virtual Nokia5110 displays which can share
+//                   the ST7735, each with its own frame buffer, shadow copy,
+//                   text cursor and position. Display 0 is the emulator window
+//                   drawn from Screen, more are added by Nokia5110Emu_OpenDisplay
+//                   and all of them sent by Nokia5110Emu_FlushDisplays. Cannot
+//                   be more than 1 with NOKIA5110EMU_SCROLL or NOKIA5110EMU_UPSCALE
+#ifndef NOKIA5110EMU_DISPLAYS
+  #define NOKIA5110EMU_DISPLAYS 1
+#endif
+// NOKIA5110EMU_HOST  Build for a PC instead of the TM4C123. Every SSI2 frame
+//                   is passed to Nokia5110Emu_HostWrite, which the host program
+//                   provides, and the cycle counter counts the time the frames
+//                   would take at the SSI2 bit rate. See tools/host_bench.c
+#ifndef NOKIA5110EMU_HOST
+  #define NOKIA5110EMU_HOST 0
+#endif
+// NOKIA5110EMU_BENCHMARK  Add Nokia5110Emu_Benchmark which times the emulator
+//                   functions with the DWT cycle counter and SysTick
+#ifndef NOKIA5110EMU_BENCHMARK
+  #define NOKIA5110EMU_BENCHMARK 0
+#endif
+// NOKIA5110EMU_STATS  Count the bytes, windows and frames sent and the cycles
+//                   spent waiting for the SSI, see Nokia5110Emu_GetStats
+#ifndef NOKIA5110EMU_STATS
+  #define NOKIA5110EMU_STATS 0
+#endif
+// NOKIA5110EMU_TRACE  Log every command, window and run of pixel data sent to
+//                   the ST7735 in a RAM ring buffer with a cycle count time stamp,
+//                   see Nokia5110Emu_TraceDump which sends it over UART0
+#ifndef NOKIA5110EMU_TRACE
+  #define NOKIA5110EMU_TRACE 0
+#endif
+// NOKIA5110EMU_TRACE_SIZE  Number of transactions the trace holds, a power of 2.
+//                   Each one takes 16 bytes, the oldest are overwritten first
+#ifndef NOKIA5110EMU_TRACE_SIZE
+  #define NOKIA5110EMU_TRACE_SIZE 256
+#endif
+// NOKIA5110EMU_TRACE_BAUD  UART0 bit rate Nokia5110Emu_TraceDump sets up, unless
+//                   UART0 is already enabled when it is used as it is
+#ifndef NOKIA5110EMU_TRACE_BAUD
+  #define NOKIA5110EMU_TRACE_BAUD 115200
+#endif
+// NOKIA5110EMU_MIRROR  Stream the emulator window over UART0 to a host viewer
+//                   as it changes, see tools/mirror_view.c. Only the changed
+//                   runs of bytes are sent, from the UART0 interrupt, and any
+//                   changes made while the UART is busy go in the next packet
+#ifndef NOKIA5110EMU_MIRROR
+  #define NOKIA5110EMU_MIRROR 0
+#endif
+// NOKIA5110EMU_MIRROR_BAUD  UART0 bit rate of the mirror
+#ifndef NOKIA5110EMU_MIRROR_BAUD
+  #define NOKIA5110EMU_MIRROR_BAUD 115200
+#endif
+// NOKIA5110EMU_STATS_OVERLAY  Show frames per second and bytes per frame below
+//                   the emulator window once a second. Requires NOKIA5110EMU_STATS
+#ifndef NOKIA5110EMU_STATS_OVERLAY
+  #define NOKIA5110EMU_STATS_OVERLAY 0
+#endif
+#if NOKIA5110EMU_STATS_OVERLAY && !NOKIA5110EMU_STATS
+  #error NOKIA5110EMU_STATS_OVERLAY requires NOKIA5110EMU_STATS
+#endif
+#if NOKIA5110EMU_HOST && (NOKIA5110EMU_DMA || NOKIA5110EMU_TX_QUEUE || NOKIA5110EMU_ASYNC_INIT || \
+    NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE || NOKIA5110EMU_BENCHMARK || NOKIA5110EMU_TRACE || \
+    NOKIA5110EMU_MIRROR)
+  #error NOKIA5110EMU_HOST cannot be used with options which need the TM4C123 interrupts, timers or UART
+#endif
+#if NOKIA5110EMU_TRACE && (NOKIA5110EMU_TRACE_SIZE & (NOKIA5110EMU_TRACE_SIZE - 1))
+  #error NOKIA5110EMU_TRACE_SIZE must be a power of 2
+#endif
+#if NOKIA5110EMU_MIRROR && NOKIA5110EMU_TRACE
+  #error NOKIA5110EMU_MIRROR cannot be used with NOKIA5110EMU_TRACE, both use UART0
+#endif
+// NOKIA5110EMU_BENCH_ITERATIONS  Number of times each benchmark is repeated
+#ifndef NOKIA5110EMU_BENCH_ITERATIONS
+  #define NOKIA5110EMU_BENCH_ITERATIONS 100
+#endif
+// SYSTEM_CLOCK_HZ   Core clock frequency, used to convert cycles to time and
+//                   to work out the SSI2 clock dividers
+#ifndef SYSTEM_CLOCK_HZ
+  #define SYSTEM_CLOCK_HZ 80000000
+#endif
+// NOKIA5110EMU_SPI_INIT_HZ  SSI2 bit rate used while the ST7735 is initialised
+#ifndef NOKIA5110EMU_SPI_INIT_HZ
+  #define NOKIA5110EMU_SPI_INIT_HZ 8000000
+#endif
+// NOKIA5110EMU_SPI_HZ  SSI2 bit rate used once the ST7735 is running,
+//                   0 selects the fastest rate the ST7735 and SSI allow
+#ifndef NOKIA5110EMU_SPI_HZ
+  #define NOKIA5110EMU_SPI_HZ 8000000
+#endif
+// ST7735_MAX_SPI_HZ Fastest serial clock for the ST7735S (66ns write cycle)
+#ifndef ST7735_MAX_SPI_HZ
+  #define ST7735_MAX_SPI_HZ 15000000
+#endif
+#if NOKIA5110EMU_DOUBLE_BUFFER && !NOKIA5110EMU_DMA
+  #error NOKIA5110EMU_DOUBLE_BUFFER requires NOKIA5110EMU_DMA
+#endif
+#if NOKIA5110EMU_TX_QUEUE && NOKIA5110EMU_DMA
+  #error NOKIA5110EMU_TX_QUEUE cannot be used with NOKIA5110EMU_DMA
+#endif
+#if NOKIA5110EMU_UPSCALE && NOKIA5110EMU_SCROLL
+  #error NOKIA5110EMU_UPSCALE cannot be used with NOKIA5110EMU_SCROLL
+#endif
+#if NOKIA5110EMU_UPSCALE && NOKIA5110EMU_NATIVE_FRAMES
+  #error NOKIA5110EMU_UPSCALE cannot be used with NOKIA5110EMU_NATIVE_FRAMES
+#endif
+#if NOKIA5110EMU_DISPLAYS > 1 && NOKIA5110EMU_SCROLL
+  #error NOKIA5110EMU_DISPLAYS cannot be more than 1 with NOKIA5110EMU_SCROLL
+#endif
+#if NOKIA5110EMU_DISPLAYS > 1 && NOKIA5110EMU_UPSCALE
+  #error NOKIA5110EMU_DISPLAYS cannot be more than 1 with NOKIA5110EMU_UPSCALE
+#endif
+#if NOKIA5110EMU_DISPLAYS < 1
+  #error NOKIA5110EMU_DISPLAYS must be at least 1
+#endif
+#if NOKIA5110EMU_UPSCALE < 0 || NOKIA5110EMU_UPSCALE > 2
+  #error NOKIA5110EMU_UPSCALE must be 0, 1 or 2
+#endif
+#if NOKIA5110EMU_TXQ_SIZE & (NOKIA5110EMU_TXQ_SIZE-1)
+  #error NOKIA5110EMU_TXQ_SIZE must be a power of 2
+#endif
+#if NOKIA5110EMU_SERVER_SLOTS & (NOKIA5110EMU_SERVER_SLOTS-1)
+  #error NOKIA5110EMU_SERVER_SLOTS must be a power of 2
+#endif
+
 // Declare the original Nokia5110 functions which are being emulated
 void Nokia5110_Init(void);
 void Nokia5110_OutChar(unsigned char data);
@@ -73,28 +333,324 @@ void Nokia5110_DrawFullImage(const char *ptr);
 void Nokia5110_PrintBMP(unsigned char xpos, unsigned char ypos, const unsigned char *ptr, unsigned char threshold);
 void Nokia5110_ClearBuffer(void);
 void Nokia5110_DisplayBuffer(void);
+// Declare the extra number formatters
+void Nokia5110Emu_OutSDec(short n);
+void Nokia5110Emu_OutUHex(unsigned short n);
+void Nokia5110Emu_OutFix(long n, unsigned char decimals);
 // Declare the Emulator Nokia5110 replacement functions 
 void Nokia5110Emu_Init(void);
 void Nokia5110Emu_OutChar(unsigned char data);
+void Nokia5110Emu_OutString(unsigned char *ptr);
 void Nokia5110Emu_SetCursor(unsigned char newX, unsigned char newY);
 void Nokia5110Emu_Clear(void);
 void Nokia5110Emu_DrawFullImage(const char *ptr);
+uint32_t Nokia5110Emu_SetSPIClock(uint32_t hz);
+uint32_t Nokia5110Emu_GetSPIClock(void);
+#if NOKIA5110EMU_DMA || NOKIA5110EMU_TX_QUEUE
+int Nokia5110Emu_Busy(void);
+void Nokia5110Emu_WaitDone(void);
+void SSI2_Handler(void);
+#endif
+#if NOKIA5110EMU_DMA
+void Nokia5110Emu_SetDoneCallback(void (*callback)(void));
+#endif
+#if NOKIA5110EMU_DOUBLE_BUFFER
+void Nokia5110Emu_Flip(void);
+#endif
+#if NOKIA5110EMU_BENCHMARK
+void Nokia5110Emu_Benchmark(void);
+#endif
+#if NOKIA5110EMU_ASYNC_INIT
+int Nokia5110Emu_Ready(void);
+#endif
+#if NOKIA5110EMU_ASYNC_INIT || NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE
+void Timer5A_Handler(void);
+#endif
+#if NOKIA5110EMU_FRAME_PACING
+struct Nokia5110Emu_PaceStats
+{
+  uint32_t presented; // frames passed to Nokia5110Emu_Present
+  uint32_t submitted; // frames sent to the LCD by Timer5A
+  uint32_t coalesced; // frames replaced by a later one before being sent
+  uint32_t late;      // ticks which found the last frame still being sent by uDMA
+};
+uint32_t Nokia5110Emu_SetFrameRate(uint32_t hz);
+void Nokia5110Emu_Present(const char *frame);
+void Nokia5110Emu_GetPaceStats(struct Nokia5110Emu_PaceStats *stats);
+#endif
+#if NOKIA5110EMU_SERVER
+int Nokia5110Emu_PostString(unsigned char x, unsigned char y, const char *ptr);
+int Nokia5110Emu_PostUDec(unsigned char x, unsigned char y, unsigned short n);
+int Nokia5110Emu_PostClear(void);
+int Nokia5110Emu_PostFrame(const char *frame);
+int Nokia5110Emu_Serve(void);
+void Nokia5110Emu_ServerThread(void);
+// provided by the RTOS
+long StartCritical(void);
+void EndCritical(long sr);
+void OS_Suspend(void);
+#endif
+#if NOKIA5110EMU_HOST
+// provided by the host program, called for each SSI2 frame with the
+// level of the LCD's RS line, 0 for a command, and the frame size
+void Nokia5110Emu_HostWrite(unsigned char rs, unsigned short value, unsigned char bits);
+#endif
+#if NOKIA5110EMU_SPRITES
+// A 1-bit image laid out in 8-row banks like Screen. data holds banks*width
+// bytes of pixels, bit 0 of each byte being the top row of its bank, followed
+// by banks*width bytes of mask with a bit set for every pixel of the sprite
+struct Nokia5110Emu_Sprite
+{
+  uint8_t width;        // columns
+  uint8_t height;       // rows
+  uint8_t banks;        // 8-row banks, (height+7)/8
+  const uint8_t *data;  // pixels then mask
+};
+// Bytes of data needed for a sprite of w by h pixels
+#define NOKIA5110EMU_SPRITE_BYTES(W, H) (2*(W)*(((H)+7)/8))
+// How Nokia5110Emu_DrawSprite combines the sprite with Screen
+#define NOKIA5110EMU_BLIT_COPY 0 // replace the pixels under the mask, like Nokia5110_PrintBMP
+#define NOKIA5110EMU_BLIT_OR   1 // turn on the pixels which are on in the sprite
+#define NOKIA5110EMU_BLIT_AND  2 // turn off the pixels under the mask which are off in the sprite
+#define NOKIA5110EMU_BLIT_XOR  3 // invert the pixels which are on in the sprite
+int Nokia5110Emu_ConvertBMP(struct Nokia5110Emu_Sprite *sprite, uint8_t *data, const unsigned char *ptr, unsigned char threshold);
+void Nokia5110Emu_DrawSprite(int x, int y, const struct Nokia5110Emu_Sprite *sprite, int mode);
+#endif
+#if NOKIA5110EMU_RASTER
+void Nokia5110Emu_FillRect(int x, int y, int width, int height, int on);
+void Nokia5110Emu_InvertRect(int x, int y, int width, int height);
+void Nokia5110Emu_ScrollBuffer(int dx, int dy);
+void Nokia5110Emu_CopyMasked(const char *src, const char *mask);
+#endif
+#if NOKIA5110EMU_PCD8544
+void Nokia5110Emu_PCD8544Write(int data, unsigned char byte);
+void Nokia5110Emu_PCD8544Flush(void);
+#endif
+#if NOKIA5110EMU_NATIVE_FRAMES
+// Bytes in one 84x48 frame packed as 12-bit pixel pairs in RAMWR order
+#define NOKIA5110EMU_NATIVE_BYTES (84*48*3/2)
+void Nokia5110Emu_DrawNative(const uint8_t *frames, unsigned short index);
+void Nokia5110Emu_PlayNative(const uint8_t *frames, unsigned short first, unsigned short count, unsigned long hz);
+#endif
+#if NOKIA5110EMU_POWER_SAVE
+// Power saving modes for Nokia5110Emu_SetPowerSave
+#define NOKIA5110EMU_POWER_IDLE    0x01 // 8-colour idle mode at the FRMCTR2 frame rate
+#define NOKIA5110EMU_POWER_PARTIAL 0x02 // only scan the rows of the emulator window
+void Nokia5110Emu_SetPowerSave(unsigned char modes, uint32_t sleep_ms);
+#endif
+#if NOKIA5110EMU_DELTA_FRAMES
+const uint8_t *Nokia5110Emu_DecodeDelta(const uint8_t *frame);
+const uint8_t *Nokia5110Emu_DrawDelta(const uint8_t *frame);
+#endif
+#if NOKIA5110EMU_DISPLAYS > 1
+int Nokia5110Emu_OpenDisplay(char *buffer, unsigned char x, unsigned char y);
+void Nokia5110Emu_MoveDisplay(int display, unsigned char x, unsigned char y);
+void Nokia5110Emu_SelectDisplay(int display);
+void Nokia5110Emu_FlushDisplays(void);
+#endif
+#if NOKIA5110EMU_STATS
+struct Nokia5110Emu_Stats
+{
+  uint32_t command_bytes; // commands and their parameters
+  uint32_t pixel_bytes;   // pixel data following RAMWR
+  uint32_t frames;        // frames sent by DisplayBuffer and DrawFullImage
+  uint32_t windows;       // CASET/RASET windows opened
+  uint32_t wait_cycles;   // cycles spent waiting for the SSI
+};
+void Nokia5110Emu_GetStats(struct Nokia5110Emu_Stats *stats);
+void Nokia5110Emu_ResetStats(void);
+void Nokia5110Emu_DrawStats(void);
+#endif
+#if NOKIA5110EMU_TRACE
+void Nokia5110Emu_TraceMark(unsigned char tag);
+void Nokia5110Emu_TraceClear(void);
+void Nokia5110Emu_TraceDump(void);
+#endif
+#if NOKIA5110EMU_MIRROR
+void Nokia5110Emu_MirrorRefresh(void);
+void UART0_Handler(void);
+#endif
+// Private types used by the private functions below
+struct LCD_context;
+struct LCD_slot;
+
 // Declare some private functions for SPI control 
 static void delay(unsigned long msec);
+#if !NOKIA5110EMU_TX_QUEUE
 static void SPI_transfer(uint8_t byte);
+#endif
 static void SPI_sendCommand(uint8_t command);
 static void SPI_sendData(uint8_t data);
+static uint32_t SPI_setClock(uint32_t hz);
+static uint32_t SPI_changeClock(uint32_t hz);
+#if NOKIA5110EMU_SSI_12BIT
+static void SPI_setFrame(uint32_t dss);
+#else
+#define SPI_setFrame(dss)   // frames are always 8-bit
+#endif
+#if NOKIA5110EMU_TX_QUEUE
+// private functions for the transmit queue
+static void LCD_txq_put(uint16_t entry);
+static void LCD_txq_write(const uint16_t* entries, uint16_t count);
+static void LCD_txq_wait(void);
+#endif
 // private functions for LCD window control
+static void LCD_set_window(uint16_t x, uint16_t y, uint16_t xsize, uint16_t ysize);
 static void LCD_resize_window (uint16_t xsize, uint16_t ysize);
 static void LCD_reset_window(void);
+#if NOKIA5110EMU_FAST_BOOT < 2 || NOKIA5110EMU_STATS_OVERLAY
+static void LCD_draw_label(uint16_t x, uint16_t y, const char* label);
+#endif
+#if NOKIA5110EMU_FAST_BOOT < 2
+static void LCD_draw_labels(void);
+#endif
+#if NOKIA5110EMU_FAST_BOOT == 0
+static void LCD_send_pattern(uint16_t first, uint16_t count);
+#endif
+#if !NOKIA5110EMU_DMA || NOKIA5110EMU_FAST_BOOT == 1 || NOKIA5110EMU_SCROLL
+static void LCD_fill_window(uint16_t colour);
+#endif
+#if NOKIA5110EMU_FAST_BOOT == 1 || NOKIA5110EMU_SCROLL
+static void LCD_fill_sides(void);
+#endif
+#if NOKIA5110EMU_FAST_BOOT == 1
+static void LCD_fill_border(void);
+#endif
 static void LCD_send_data(const char* buffer);
+static void LCD_send_region(const char* buffer, uint16_t stride);
+static void LCD_stream_region(const char* buffer, uint16_t stride);
+static void LCD_stream_glyph(const char* buffer);
+static void LCD_stream_frame(const char* buffer);
+static void LCD_stream_strip(const char* buffer);
+#if NOKIA5110EMU_GLYPH_ATLAS || (NOKIA5110EMU_NATIVE_FRAMES && !NOKIA5110EMU_DMA)
+static void LCD_send_packed(const uint8_t* data, uint16_t count);
+#endif
+#if NOKIA5110EMU_UPSCALE
+#if !NOKIA5110EMU_DMA
+static void LCD_send_scaled(const char* buffer, uint16_t count);
+#endif
+static void LCD_send_text(uint16_t xsize);
+#endif
+// private functions for tracking changes to the emulator window
+static void LCD_update_window(const char* buffer);
+static int LCD_find_span(const char* new_bank, const char* old_bank, uint16_t* first, uint16_t* last);
+static void LCD_send_span(uint16_t bank, uint16_t first, uint16_t last);
+static void LCD_fill_span(uint16_t bank, uint16_t first, uint16_t last, uint8_t bits);
+static void LCD_span_window(const struct LCD_context* ctx, uint16_t bank, uint16_t first, uint16_t last, uint16_t rows);
+#if NOKIA5110EMU_DISPLAYS > 1
+static void LCD_flush_window(const struct LCD_slot* slot, uint16_t count, uint16_t first, uint16_t last);
+#endif
+static void LCD_update_shadow(const char* data, uint16_t xsize);
+#if NOKIA5110EMU_SPRITES
+// private functions for sprites
+static void LCD_blit(char *dest, uint8_t pixels, uint8_t mask, int mode);
+#endif
+#if NOKIA5110EMU_RASTER
+// private functions for raster operations
+static void LCD_raster_rect(int x, int y, int width, int height, uint8_t op);
+static void LCD_raster_span(char* dest, uint16_t count, uint8_t mask, uint8_t op);
+#endif
+// private functions for text output
+static int LCD_out_run(const unsigned char* ptr);
+static void LCD_udec_string(char* digits, unsigned short n);
+static void LCD_sdec_string(char* digits, short n);
+static void LCD_fix_string(char* out, long n, unsigned char decimals);
+// Digits of any unsigned long, and LCD_fix_string's output with the sign,
+// decimal point and terminator, however wide long is
+#define LCD_FIX_DIGITS     (3*sizeof(long))
+#define LCD_FIX_CHARS      (LCD_FIX_DIGITS + 3)
+#if NOKIA5110EMU_BUFFERED_TEXT
+static void LCD_buffer_char(unsigned char data);
+#endif
+static void LCD_advance_cursor(uint16_t xsize);
+static uint16_t LCD_text_row(void);
+#if NOKIA5110EMU_SCROLL
+static void LCD_scroll_line(void);
+static void LCD_scroll_to(uint16_t offset);
+#endif
+#if NOKIA5110EMU_GLYPH_ATLAS
+static void LCD_send_glyphs(const unsigned char* ptr, int count);
+#endif
+#if NOKIA5110EMU_DMA
+// private functions for uDMA transfers
+#if !NOKIA5110EMU_UPSCALE
+static void LCD_expand_region(uint8_t* dest, const char* buffer, uint16_t stride, uint16_t xsize, uint16_t ysize);
+#endif
+#if NOKIA5110EMU_UPSCALE
+static void LCD_expand_scaled(uint8_t* dest, const char* buffer, uint16_t count);
+#endif
+static void LCD_dma_add(uint16_t bank, uint16_t first, uint16_t last, uint8_t solid, uint8_t pattern);
+static void LCD_dma_expand(uint8_t region);
+static void LCD_dma_start(uint8_t region);
+static void LCD_dma_kick(void);
+static void LCD_dma_wait(void);
+#endif
+
+// private functions for bringing up the LCD
+static void LCD_configure(void);
+static void LCD_set_format(void);
+static int LCD_deferred(void);
+#if NOKIA5110EMU_POWER_SAVE
+static void LCD_power_apply(void);
+static void LCD_power_touch(void);
+static void LCD_power_wake(void);
+static void LCD_power_sleep(void);
+#endif
+#if NOKIA5110EMU_ASYNC_INIT
+static void LCD_boot_step(void);
+static void LCD_boot_wait(uint32_t msec);
+static void LCD_show_window(void);
+#endif
+#if NOKIA5110EMU_FRAME_PACING
+// private functions for frame pacing
+static void LCD_pace_start(void);
+static void LCD_pace_tick(void);
+#endif
+#if NOKIA5110EMU_NATIVE_FRAMES
+// private function for native frames
+static void LCD_unpack_native(char* shadow, const uint8_t* frame);
+#endif
+
+#if NOKIA5110EMU_TRACE
+// private functions for the SPI trace
+static void LCD_trace_add(uint8_t type, uint8_t code, uint16_t bytes);
+static void LCD_trace_command(uint8_t byte, uint8_t command);
+static void LCD_trace_send(uint32_t value, uint8_t bytes);
+#endif
+
+#if NOKIA5110EMU_MIRROR
+// private functions for the UART0 mirror
+static uint16_t LCD_mirror_encode(void);
+static uint16_t LCD_mirror_same(const char* new_bank, const char* old_bank, uint16_t i, uint16_t last);
+static uint8_t *LCD_mirror_skip(uint8_t *p, uint16_t count);
+#endif
+
+#if NOKIA5110EMU_HOST
+// private function for the host build
+static void LCD_host_send(uint16_t value);
+#endif
 
 void Initialize_LCD(void);
 void Initialize_SPI(void);
 void Initialize_Launchpad(void);
+#if NOKIA5110EMU_TRACE || NOKIA5110EMU_MIRROR
+void Initialize_UART0(void);
+#endif
+#if NOKIA5110EMU_MIRROR
+void Initialize_Mirror(void);
+#endif
+#if NOKIA5110EMU_DMA
+void Initialize_UDMA(void);
+#endif
+#if NOKIA5110EMU_ASYNC_INIT || NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE
+void Initialize_Timer5(void);
+#endif
 
 // Define some constants
 #define BIT(X)    (1L<<(X))
+// A 32-bit word with each of its bytes set to B, for working on four columns
+// of a bank at once
+#define LCD_LANES(B) ((uint32_t)(uint8_t)(B)*0x01010101UL)
 
 #define LCD_RS_B BIT(4)
 #define LCD_RESET_B BIT(0)
@@ -102,6 +658,24 @@ void Initialize_Launchpad(void);
 #define LCD_MOSI_B BIT(7)
 #define LCD_SCK_B BIT(4)
 
+#if NOKIA5110EMU_HOST
+// Only the RS level is passed on to the host, the other lines are not modelled
+#define CLR_RS    (LCD_host_rs = 0)
+#define SET_RS    (LCD_host_rs = 1)
+#define CLR_RESET ((void)0)
+#define SET_RESET ((void)0)
+#define CLR_CS    ((void)0)
+#define SET_CS    ((void)0)
+#define CLR_MOSI  ((void)0)
+#define SET_MOSI  ((void)0)
+#define CLR_SCK   ((void)0)
+#define SET_SCK   ((void)0)
+
+// The cycle counter is the time the frames sent so far would take on SSI2
+#define DEMCR_R            (LCD_host_debug[0])
+#define DWT_CTRL_R         (LCD_host_debug[1])
+#define DWT_CYCCNT_R       (LCD_host_cycles)
+#else
 #define CLR_RS    (GPIO_PORTF_DATA_R &= ~LCD_RS_B)
 #define SET_RS    (GPIO_PORTF_DATA_R |=  LCD_RS_B)
 #define CLR_RESET (GPIO_PORTF_DATA_R &= ~LCD_RESET_B)
@@ -113,6 +687,82 @@ void Initialize_Launchpad(void);
 #define CLR_SCK   (GPIO_PORTB_DATA_R &= ~LCD_SCK_B)
 #define SET_SCK   (GPIO_PORTB_DATA_R |=  LCD_SCK_B)
 
+// Cortex-M4 debug registers for the cycle counter, not in tm4c123gh6pm.h
+#define DEMCR_R            (*((volatile uint32_t *)0xE000EDFC))
+#define DWT_CTRL_R         (*((volatile uint32_t *)0xE0001000))
+#define DWT_CYCCNT_R       (*((volatile uint32_t *)0xE0001004))
+#endif
+#define DEMCR_TRCENA       0x01000000  // enable DWT
+#define DWT_CTRL_CYCCNTENA 0x00000001  // enable cycle counter
+
+#if NOKIA5110EMU_STATS
+// Add to one of the statistics counters
+#define LCD_STAT(FIELD, N) (LCD_stats.FIELD += (N))
+#else
+#define LCD_STAT(FIELD, N)
+#endif
+#if NOKIA5110EMU_TRACE
+// Transaction types in the trace
+#define LCD_TRACE_COMMAND 0 // code is the command, bytes includes its parameters
+#define LCD_TRACE_WINDOW  1 // CASET, RASET and RAMWR for the window in the entry
+#define LCD_TRACE_DATA    2 // pixel data for the window in the entry
+#define LCD_TRACE_MARK    3 // Nokia5110Emu_TraceMark, code is its tag
+// Add a transaction to the trace
+#define LCD_TRACE(TYPE, CODE, BYTES) LCD_trace_add(TYPE, CODE, BYTES)
+// Charge cycles spent waiting for the SSI to the last transaction
+#define LCD_TRACE_WAIT(N) (LCD_trace[(LCD_trace_next - 1)&(NOKIA5110EMU_TRACE_SIZE - 1)].wait += (N))
+#else
+#define LCD_TRACE(TYPE, CODE, BYTES)
+#define LCD_TRACE_WAIT(N)
+#endif
+
+#if NOKIA5110EMU_HOST
+// Frames go straight to the host so there is never anything to wait for
+#define SSI2_WAIT_IDLE() do { } while(0)
+#define SSI2_WRITE(B) LCD_host_send(B)
+#elif NOKIA5110EMU_STATS || NOKIA5110EMU_TRACE
+// Wait until SSI2 is not busy, counting the cycles spent waiting
+#define SSI2_WAIT_IDLE() do { if((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){ uint32_t t = DWT_CYCCNT_R; \
+    while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){}; t = DWT_CYCCNT_R - t; \
+    LCD_STAT(wait_cycles, t); LCD_TRACE_WAIT(t); } } while(0)
+// Write one byte of pixel data as soon as there is room in the SSI2 transmit FIFO
+#define SSI2_WRITE(B) do { if((SSI2_SR_R&SSI_SR_TNF)==0){ uint32_t t = DWT_CYCCNT_R; \
+    while((SSI2_SR_R&SSI_SR_TNF)==0){}; t = DWT_CYCCNT_R - t; \
+    LCD_STAT(wait_cycles, t); LCD_TRACE_WAIT(t); } SSI2_DR_R = (B); } while(0)
+#else
+// Wait until SSI2 is not busy/transmit FIFO empty
+#define SSI2_WAIT_IDLE() do { while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){}; } while(0)
+// Write one byte of pixel data as soon as there is room in the SSI2 transmit FIFO
+#define SSI2_WRITE(B) do { while((SSI2_SR_R&SSI_SR_TNF)==0){}; SSI2_DR_R = (B); } while(0)
+#endif
+
+#if NOKIA5110EMU_TX_QUEUE
+// Transmit queue entries hold a byte or 12-bit pixel with the RS level and
+// frame size it must be sent with, SSI2_Handler sets both up as it goes
+#define LCD_TXQ_VALUE  0x0FFF // byte or pixel to send
+#define LCD_TXQ_WIDE   0x4000 // send as a 12-bit frame
+#define LCD_TXQ_DATA   0x8000 // send with RS high, otherwise it is a command
+#define LCD_TXQ_MODE   (LCD_TXQ_DATA|LCD_TXQ_WIDE)
+// The SSI2 interrupt is number 57
+#define LCD_TXQ_INT_B  BIT(57-32)
+// Pixel data for the current window is added to the transmit queue
+#define LCD_TX_DATA()
+#define LCD_TX(B)      LCD_txq_put(LCD_TXQ_DATA|LCD_txq_frame|(B))
+#define LCD_TX_END()
+#else
+// Pixel data for the current window is written straight to the SSI2 FIFO
+#define LCD_TX_DATA()  do { SET_RS; CLR_CS; } while(0)
+#define LCD_TX(B)      SSI2_WRITE(B)
+#define LCD_TX_END()   do { SSI2_WAIT_IDLE(); CLR_CS; } while(0)
+#endif
+
+// Fastest SSI clock in master mode, SysClk/2 and no more than 25MHz
+#if SYSTEM_CLOCK_HZ/2 < 25000000
+  #define SSI_MAX_MASTER_HZ (SYSTEM_CLOCK_HZ/2)
+#else
+  #define SSI_MAX_MASTER_HZ 25000000
+#endif
+
 // Maximum dimensions of the Nokia LCD, although the pixels are
 // numbered from zero to (MAX-1).  Address may automatically
 // be incremented after each transmission.
@@ -124,11 +774,57 @@ void Initialize_Launchpad(void);
 #ifndef SCREENH
   #define SCREENH NOKIA_MAX_Y
 #endif
+#if NOKIA5110EMU_RASTER && (SCREENW % 4)
+  #error NOKIA5110EMU_RASTER needs each bank of Screen to be whole words
+#endif
+// Every LCD_SCALE_IN columns of a bank are shown as LCD_SCALE_OUT columns of
+// the LCD, always a whole number of pixel pairs, and each bank as
+// LCD_BANK_ROWS rows
+#if NOKIA5110EMU_UPSCALE
+  #define LCD_SCALE_IN          4
+  #define LCD_SCALE_OUT         6
+  #define LCD_BANK_ROWS         (NOKIA5110EMU_UPSCALE == 1 ? 12 : 16)
+#else
+  #define LCD_SCALE_IN          2
+  #define LCD_SCALE_OUT         2
+  #define LCD_BANK_ROWS         8
+#endif
+#if SCREENW % LCD_SCALE_IN
+  #error NOKIA5110EMU_UPSCALE needs the width of Screen to be a multiple of 4
+#endif
+// LCD column of the emulator window showing column X of a bank, X must be
+// the first column of a group of LCD_SCALE_IN
+#define LCD_SCALE_X(X)          ((X)/LCD_SCALE_IN*LCD_SCALE_OUT)
+// Size of the emulator window on the ST7735
+#define LCD_VIEW_W              LCD_SCALE_X(NOKIA_MAX_X)
+#define LCD_VIEW_H              (NOKIA_MAX_Y/8*LCD_BANK_ROWS)
 // Maximum dimensions of the ST7735, although the pixels are
 // numbered from zero to (MAX-1).  Address may automatically
 // be incremented after each transmission.
 #define ST7735_MAX_X            128
 #define ST7735_MAX_Y            128
+// Position of the Nokia 5110 emulator window, centred on the ST7735
+#define NOKIA_WINDOW_X          ((ST7735_MAX_X - LCD_VIEW_W)/2)
+#define NOKIA_WINDOW_Y          ((ST7735_MAX_Y - LCD_VIEW_H)/2)
+// Width of the border filled either side of the emulator window, an odd
+// border is widened by one column into the window which is drawn after it
+#define LCD_SIDE_W              ((NOKIA_WINDOW_X + 1) & ~1)
+// Row of the first of the two emulator labels, three text rows above the
+// window unless they only fit in the border one row higher
+#if NOKIA_WINDOW_Y >= 3*8
+  #define LCD_LABEL_Y           (NOKIA_WINDOW_Y - 3*8)
+#else
+  #define LCD_LABEL_Y           (NOKIA_WINDOW_Y - 2*8)
+#endif
+// Hardware scroll area covering the rows of the emulator window. The frame
+// memory has 162 lines and MY=1 stores rows bottom to top, so the fixed area
+// below the window (and the one line row offset) comes first in memory
+#define ST7735_GRAM_ROWS        162
+#define LCD_SCROLL_BFA          (NOKIA_WINDOW_Y + 1)
+#define LCD_SCROLL_TFA          (ST7735_GRAM_ROWS - LCD_SCROLL_BFA - LCD_VIEW_H)
+// Frame memory lines scanned in partial mode, the same lines as the scroll area
+#define LCD_PARTIAL_START       LCD_SCROLL_TFA
+#define LCD_PARTIAL_END         (LCD_SCROLL_TFA + LCD_VIEW_H - 1)
 
 // This table contains the hex values that represent pixels
 // for a font that is 6 pixels wide and 8 pixels high
@@ -139,119 +835,462 @@ void Initialize_Launchpad(void);
 //                     RGB 
 #define PIXEL_ON   (0x0000)  // Black
 #define PIXEL_OFF  (0x0FFF)  // White
+#define PIXEL_BORDER (0x048C) // Steel blue, around the window with NOKIA5110EMU_FAST_BOOT 1
+
+// Two adjacent 12-bit pixels packed into three bytes RRRRGGGG BBBBRRRR GGGGBBBB
+#define PIXEL_PAIR_BYTES(P1, P2) ((P1)&0x0FF0)>>4, (((P1)&0x000F)<<4)|(((P2)&0x0F00)>>8), (P2)&0x00FF
+#define PIXEL_PAIR(P1, P2) { PIXEL_PAIR_BYTES(P1, P2) }
+// Pixel value for one bit of a bank at row shift in 12-bit frame mode
+#define LCD_PIXEL(BANK, COL, SHIFT) ((((BANK)[COL]>>(SHIFT))&1) ? PIXEL_ON : PIXEL_OFF)
+// Index into LCD_pixel_pair for columns col and col+1 of a bank at row shift
+#define LCD_PAIR_INDEX(BANK, COL, SHIFT) ((((BANK)[COL]>>(SHIFT))&1) | ((((BANK)[(COL)+1]>>(SHIFT))&1)<<1))
+// Bank of LCD memory and the shadow copy holding bank BANK of the screen
+#if NOKIA5110EMU_SCROLL
+#define LCD_STORED_BANK(BANK) (((BANK) + LCD_scroll_y/8) % (NOKIA_MAX_Y/8))
+#else
+#define LCD_STORED_BANK(BANK) (BANK)
+#endif
 
 // Declare Module-private data
 // modified ASCII character table with explicit blank column
+// Each glyph is listed once here and expanded into ASCII6 below
+#define ASCII6_TABLE(GLYPH) \
+  GLYPH(0x00, 0x00, 0x00, 0x00, 0x00, 0x00) /* 20 */ \
+  GLYPH(0x00, 0x00, 0x5f, 0x00, 0x00, 0x00) /* 21 ! */ \
+  GLYPH(0x00, 0x07, 0x00, 0x07, 0x00, 0x00) /* 22 " */ \
+  GLYPH(0x14, 0x7f, 0x14, 0x7f, 0x14, 0x00) /* 23 # */ \
+  GLYPH(0x24, 0x2a, 0x7f, 0x2a, 0x12, 0x00) /* 24 $ */ \
+  GLYPH(0x23, 0x13, 0x08, 0x64, 0x62, 0x00) /* 25 % */ \
+  GLYPH(0x36, 0x49, 0x55, 0x22, 0x50, 0x00) /* 26 & */ \
+  GLYPH(0x00, 0x05, 0x03, 0x00, 0x00, 0x00) /* 27 ' */ \
+  GLYPH(0x00, 0x1c, 0x22, 0x41, 0x00, 0x00) /* 28 ( */ \
+  GLYPH(0x00, 0x41, 0x22, 0x1c, 0x00, 0x00) /* 29 ) */ \
+  GLYPH(0x14, 0x08, 0x3e, 0x08, 0x14, 0x00) /* 2a * */ \
+  GLYPH(0x08, 0x08, 0x3e, 0x08, 0x08, 0x00) /* 2b + */ \
+  GLYPH(0x00, 0x50, 0x30, 0x00, 0x00, 0x00) /* 2c , */ \
+  GLYPH(0x08, 0x08, 0x08, 0x08, 0x08, 0x00) /* 2d - */ \
+  GLYPH(0x00, 0x60, 0x60, 0x00, 0x00, 0x00) /* 2e . */ \
+  GLYPH(0x20, 0x10, 0x08, 0x04, 0x02, 0x00) /* 2f / */ \
+  GLYPH(0x3e, 0x51, 0x49, 0x45, 0x3e, 0x00) /* 30 0 */ \
+  GLYPH(0x00, 0x42, 0x7f, 0x40, 0x00, 0x00) /* 31 1 */ \
+  GLYPH(0x42, 0x61, 0x51, 0x49, 0x46, 0x00) /* 32 2 */ \
+  GLYPH(0x21, 0x41, 0x45, 0x4b, 0x31, 0x00) /* 33 3 */ \
+  GLYPH(0x18, 0x14, 0x12, 0x7f, 0x10, 0x00) /* 34 4 */ \
+  GLYPH(0x27, 0x45, 0x45, 0x45, 0x39, 0x00) /* 35 5 */ \
+  GLYPH(0x3c, 0x4a, 0x49, 0x49, 0x30, 0x00) /* 36 6 */ \
+  GLYPH(0x01, 0x71, 0x09, 0x05, 0x03, 0x00) /* 37 7 */ \
+  GLYPH(0x36, 0x49, 0x49, 0x49, 0x36, 0x00) /* 38 8 */ \
+  GLYPH(0x06, 0x49, 0x49, 0x29, 0x1e, 0x00) /* 39 9 */ \
+  GLYPH(0x00, 0x36, 0x36, 0x00, 0x00, 0x00) /* 3a : */ \
+  GLYPH(0x00, 0x56, 0x36, 0x00, 0x00, 0x00) /* 3b ; */ \
+  GLYPH(0x08, 0x14, 0x22, 0x41, 0x00, 0x00) /* 3c < */ \
+  GLYPH(0x14, 0x14, 0x14, 0x14, 0x14, 0x00) /* 3d = */ \
+  GLYPH(0x00, 0x41, 0x22, 0x14, 0x08, 0x00) /* 3e > */ \
+  GLYPH(0x02, 0x01, 0x51, 0x09, 0x06, 0x00) /* 3f ? */ \
+  GLYPH(0x32, 0x49, 0x79, 0x41, 0x3e, 0x00) /* 40 @ */ \
+  GLYPH(0x7e, 0x11, 0x11, 0x11, 0x7e, 0x00) /* 41 A */ \
+  GLYPH(0x7f, 0x49, 0x49, 0x49, 0x36, 0x00) /* 42 B */ \
+  GLYPH(0x3e, 0x41, 0x41, 0x41, 0x22, 0x00) /* 43 C */ \
+  GLYPH(0x7f, 0x41, 0x41, 0x22, 0x1c, 0x00) /* 44 D */ \
+  GLYPH(0x7f, 0x49, 0x49, 0x49, 0x41, 0x00) /* 45 E */ \
+  GLYPH(0x7f, 0x09, 0x09, 0x09, 0x01, 0x00) /* 46 F */ \
+  GLYPH(0x3e, 0x41, 0x49, 0x49, 0x7a, 0x00) /* 47 G */ \
+  GLYPH(0x7f, 0x08, 0x08, 0x08, 0x7f, 0x00) /* 48 H */ \
+  GLYPH(0x00, 0x41, 0x7f, 0x41, 0x00, 0x00) /* 49 I */ \
+  GLYPH(0x20, 0x40, 0x41, 0x3f, 0x01, 0x00) /* 4a J */ \
+  GLYPH(0x7f, 0x08, 0x14, 0x22, 0x41, 0x00) /* 4b K */ \
+  GLYPH(0x7f, 0x40, 0x40, 0x40, 0x40, 0x00) /* 4c L */ \
+  GLYPH(0x7f, 0x02, 0x0c, 0x02, 0x7f, 0x00) /* 4d M */ \
+  GLYPH(0x7f, 0x04, 0x08, 0x10, 0x7f, 0x00) /* 4e N */ \
+  GLYPH(0x3e, 0x41, 0x41, 0x41, 0x3e, 0x00) /* 4f O */ \
+  GLYPH(0x7f, 0x09, 0x09, 0x09, 0x06, 0x00) /* 50 P */ \
+  GLYPH(0x3e, 0x41, 0x51, 0x21, 0x5e, 0x00) /* 51 Q */ \
+  GLYPH(0x7f, 0x09, 0x19, 0x29, 0x46, 0x00) /* 52 R */ \
+  GLYPH(0x46, 0x49, 0x49, 0x49, 0x31, 0x00) /* 53 S */ \
+  GLYPH(0x01, 0x01, 0x7f, 0x01, 0x01, 0x00) /* 54 T */ \
+  GLYPH(0x3f, 0x40, 0x40, 0x40, 0x3f, 0x00) /* 55 U */ \
+  GLYPH(0x1f, 0x20, 0x40, 0x20, 0x1f, 0x00) /* 56 V */ \
+  GLYPH(0x3f, 0x40, 0x38, 0x40, 0x3f, 0x00) /* 57 W */ \
+  GLYPH(0x63, 0x14, 0x08, 0x14, 0x63, 0x00) /* 58 X */ \
+  GLYPH(0x07, 0x08, 0x70, 0x08, 0x07, 0x00) /* 59 Y */ \
+  GLYPH(0x61, 0x51, 0x49, 0x45, 0x43, 0x00) /* 5a Z */ \
+  GLYPH(0x00, 0x7f, 0x41, 0x41, 0x00, 0x00) /* 5b [ */ \
+  GLYPH(0x02, 0x04, 0x08, 0x10, 0x20, 0x00) /* 5c '\' */ \
+  GLYPH(0x00, 0x41, 0x41, 0x7f, 0x00, 0x00) /* 5d ] */ \
+  GLYPH(0x04, 0x02, 0x01, 0x02, 0x04, 0x00) /* 5e ^ */ \
+  GLYPH(0x40, 0x40, 0x40, 0x40, 0x40, 0x00) /* 5f _ */ \
+  GLYPH(0x00, 0x01, 0x02, 0x04, 0x00, 0x00) /* 60 ` */ \
+  GLYPH(0x20, 0x54, 0x54, 0x54, 0x78, 0x00) /* 61 a */ \
+  GLYPH(0x7f, 0x48, 0x44, 0x44, 0x38, 0x00) /* 62 b */ \
+  GLYPH(0x38, 0x44, 0x44, 0x44, 0x20, 0x00) /* 63 c */ \
+  GLYPH(0x38, 0x44, 0x44, 0x48, 0x7f, 0x00) /* 64 d */ \
+  GLYPH(0x38, 0x54, 0x54, 0x54, 0x18, 0x00) /* 65 e */ \
+  GLYPH(0x08, 0x7e, 0x09, 0x01, 0x02, 0x00) /* 66 f */ \
+  GLYPH(0x0c, 0x52, 0x52, 0x52, 0x3e, 0x00) /* 67 g */ \
+  GLYPH(0x7f, 0x08, 0x04, 0x04, 0x78, 0x00) /* 68 h */ \
+  GLYPH(0x00, 0x44, 0x7d, 0x40, 0x00, 0x00) /* 69 i */ \
+  GLYPH(0x20, 0x40, 0x44, 0x3d, 0x00, 0x00) /* 6a j */ \
+  GLYPH(0x7f, 0x10, 0x28, 0x44, 0x00, 0x00) /* 6b k */ \
+  GLYPH(0x00, 0x41, 0x7f, 0x40, 0x00, 0x00) /* 6c l */ \
+  GLYPH(0x7c, 0x04, 0x18, 0x04, 0x78, 0x00) /* 6d m */ \
+  GLYPH(0x7c, 0x08, 0x04, 0x04, 0x78, 0x00) /* 6e n */ \
+  GLYPH(0x38, 0x44, 0x44, 0x44, 0x38, 0x00) /* 6f o */ \
+  GLYPH(0x7c, 0x14, 0x14, 0x14, 0x08, 0x00) /* 70 p */ \
+  GLYPH(0x08, 0x14, 0x14, 0x18, 0x7c, 0x00) /* 71 q */ \
+  GLYPH(0x7c, 0x08, 0x04, 0x04, 0x08, 0x00) /* 72 r */ \
+  GLYPH(0x48, 0x54, 0x54, 0x54, 0x20, 0x00) /* 73 s */ \
+  GLYPH(0x04, 0x3f, 0x44, 0x40, 0x20, 0x00) /* 74 t */ \
+  GLYPH(0x3c, 0x40, 0x40, 0x20, 0x7c, 0x00) /* 75 u */ \
+  GLYPH(0x1c, 0x20, 0x40, 0x20, 0x1c, 0x00) /* 76 v */ \
+  GLYPH(0x3c, 0x40, 0x30, 0x40, 0x3c, 0x00) /* 77 w */ \
+  GLYPH(0x44, 0x28, 0x10, 0x28, 0x44, 0x00) /* 78 x */ \
+  GLYPH(0x0c, 0x50, 0x50, 0x50, 0x3c, 0x00) /* 79 y */ \
+  GLYPH(0x44, 0x64, 0x54, 0x4c, 0x44, 0x00) /* 7a z */ \
+  GLYPH(0x00, 0x08, 0x36, 0x41, 0x00, 0x00) /* 7b { */ \
+  GLYPH(0x00, 0x00, 0x7f, 0x00, 0x00, 0x00) /* 7c | */ \
+  GLYPH(0x00, 0x41, 0x36, 0x08, 0x00, 0x00) /* 7d } */ \
+  GLYPH(0x10, 0x08, 0x08, 0x10, 0x08, 0x00) /* 7e ~ */ \
+/*GLYPH(0x78, 0x46, 0x41, 0x46, 0x78, 0x00)   7f DEL */ \
+  GLYPH(0x1f, 0x24, 0x7c, 0x24, 0x1f, 0x00) /* 7f UT sign */
+#define ASCII6_GLYPH(C0, C1, C2, C3, C4, C5) {C0, C1, C2, C3, C4, C5},
 static const char ASCII6[][6] = {
-   {0x00, 0x00, 0x00, 0x00, 0x00, 0x00} // 20
-  ,{0x00, 0x00, 0x5f, 0x00, 0x00, 0x00} // 21 !
-  ,{0x00, 0x07, 0x00, 0x07, 0x00, 0x00} // 22 "
-  ,{0x14, 0x7f, 0x14, 0x7f, 0x14, 0x00} // 23 #
-  ,{0x24, 0x2a, 0x7f, 0x2a, 0x12, 0x00} // 24 $
-  ,{0x23, 0x13, 0x08, 0x64, 0x62, 0x00} // 25 %
-  ,{0x36, 0x49, 0x55, 0x22, 0x50, 0x00} // 26 &
-  ,{0x00, 0x05, 0x03, 0x00, 0x00, 0x00} // 27 '
-  ,{0x00, 0x1c, 0x22, 0x41, 0x00, 0x00} // 28 (
-  ,{0x00, 0x41, 0x22, 0x1c, 0x00, 0x00} // 29 )
-  ,{0x14, 0x08, 0x3e, 0x08, 0x14, 0x00} // 2a *
-  ,{0x08, 0x08, 0x3e, 0x08, 0x08, 0x00} // 2b +
-  ,{0x00, 0x50, 0x30, 0x00, 0x00, 0x00} // 2c ,
-  ,{0x08, 0x08, 0x08, 0x08, 0x08, 0x00} // 2d -
-  ,{0x00, 0x60, 0x60, 0x00, 0x00, 0x00} // 2e .
-  ,{0x20, 0x10, 0x08, 0x04, 0x02, 0x00} // 2f /
-  ,{0x3e, 0x51, 0x49, 0x45, 0x3e, 0x00} // 30 0
-  ,{0x00, 0x42, 0x7f, 0x40, 0x00, 0x00} // 31 1
-  ,{0x42, 0x61, 0x51, 0x49, 0x46, 0x00} // 32 2
-  ,{0x21, 0x41, 0x45, 0x4b, 0x31, 0x00} // 33 3
-  ,{0x18, 0x14, 0x12, 0x7f, 0x10, 0x00} // 34 4
-  ,{0x27, 0x45, 0x45, 0x45, 0x39, 0x00} // 35 5
-  ,{0x3c, 0x4a, 0x49, 0x49, 0x30, 0x00} // 36 6
-  ,{0x01, 0x71, 0x09, 0x05, 0x03, 0x00} // 37 7
-  ,{0x36, 0x49, 0x49, 0x49, 0x36, 0x00} // 38 8
-  ,{0x06, 0x49, 0x49, 0x29, 0x1e, 0x00} // 39 9
-  ,{0x00, 0x36, 0x36, 0x00, 0x00, 0x00} // 3a :
-  ,{0x00, 0x56, 0x36, 0x00, 0x00, 0x00} // 3b ;
-  ,{0x08, 0x14, 0x22, 0x41, 0x00, 0x00} // 3c <
-  ,{0x14, 0x14, 0x14, 0x14, 0x14, 0x00} // 3d =
-  ,{0x00, 0x41, 0x22, 0x14, 0x08, 0x00} // 3e >
-  ,{0x02, 0x01, 0x51, 0x09, 0x06, 0x00} // 3f ?
-  ,{0x32, 0x49, 0x79, 0x41, 0x3e, 0x00} // 40 @
-  ,{0x7e, 0x11, 0x11, 0x11, 0x7e, 0x00} // 41 A
-  ,{0x7f, 0x49, 0x49, 0x49, 0x36, 0x00} // 42 B
-  ,{0x3e, 0x41, 0x41, 0x41, 0x22, 0x00} // 43 C
-  ,{0x7f, 0x41, 0x41, 0x22, 0x1c, 0x00} // 44 D
-  ,{0x7f, 0x49, 0x49, 0x49, 0x41, 0x00} // 45 E
-  ,{0x7f, 0x09, 0x09, 0x09, 0x01, 0x00} // 46 F
-  ,{0x3e, 0x41, 0x49, 0x49, 0x7a, 0x00} // 47 G
-  ,{0x7f, 0x08, 0x08, 0x08, 0x7f, 0x00} // 48 H
-  ,{0x00, 0x41, 0x7f, 0x41, 0x00, 0x00} // 49 I
-  ,{0x20, 0x40, 0x41, 0x3f, 0x01, 0x00} // 4a J
-  ,{0x7f, 0x08, 0x14, 0x22, 0x41, 0x00} // 4b K
-  ,{0x7f, 0x40, 0x40, 0x40, 0x40, 0x00} // 4c L
-  ,{0x7f, 0x02, 0x0c, 0x02, 0x7f, 0x00} // 4d M
-  ,{0x7f, 0x04, 0x08, 0x10, 0x7f, 0x00} // 4e N
-  ,{0x3e, 0x41, 0x41, 0x41, 0x3e, 0x00} // 4f O
-  ,{0x7f, 0x09, 0x09, 0x09, 0x06, 0x00} // 50 P
-  ,{0x3e, 0x41, 0x51, 0x21, 0x5e, 0x00} // 51 Q
-  ,{0x7f, 0x09, 0x19, 0x29, 0x46, 0x00} // 52 R
-  ,{0x46, 0x49, 0x49, 0x49, 0x31, 0x00} // 53 S
-  ,{0x01, 0x01, 0x7f, 0x01, 0x01, 0x00} // 54 T
-  ,{0x3f, 0x40, 0x40, 0x40, 0x3f, 0x00} // 55 U
-  ,{0x1f, 0x20, 0x40, 0x20, 0x1f, 0x00} // 56 V
-  ,{0x3f, 0x40, 0x38, 0x40, 0x3f, 0x00} // 57 W
-  ,{0x63, 0x14, 0x08, 0x14, 0x63, 0x00} // 58 X
-  ,{0x07, 0x08, 0x70, 0x08, 0x07, 0x00} // 59 Y
-  ,{0x61, 0x51, 0x49, 0x45, 0x43, 0x00} // 5a Z
-  ,{0x00, 0x7f, 0x41, 0x41, 0x00, 0x00} // 5b [
-  ,{0x02, 0x04, 0x08, 0x10, 0x20, 0x00} // 5c '\'
-  ,{0x00, 0x41, 0x41, 0x7f, 0x00, 0x00} // 5d ]
-  ,{0x04, 0x02, 0x01, 0x02, 0x04, 0x00} // 5e ^
-  ,{0x40, 0x40, 0x40, 0x40, 0x40, 0x00} // 5f _
-  ,{0x00, 0x01, 0x02, 0x04, 0x00, 0x00} // 60 `
-  ,{0x20, 0x54, 0x54, 0x54, 0x78, 0x00} // 61 a
-  ,{0x7f, 0x48, 0x44, 0x44, 0x38, 0x00} // 62 b
-  ,{0x38, 0x44, 0x44, 0x44, 0x20, 0x00} // 63 c
-  ,{0x38, 0x44, 0x44, 0x48, 0x7f, 0x00} // 64 d
-  ,{0x38, 0x54, 0x54, 0x54, 0x18, 0x00} // 65 e
-  ,{0x08, 0x7e, 0x09, 0x01, 0x02, 0x00} // 66 f
-  ,{0x0c, 0x52, 0x52, 0x52, 0x3e, 0x00} // 67 g
-  ,{0x7f, 0x08, 0x04, 0x04, 0x78, 0x00} // 68 h
-  ,{0x00, 0x44, 0x7d, 0x40, 0x00, 0x00} // 69 i
-  ,{0x20, 0x40, 0x44, 0x3d, 0x00, 0x00} // 6a j
-  ,{0x7f, 0x10, 0x28, 0x44, 0x00, 0x00} // 6b k
-  ,{0x00, 0x41, 0x7f, 0x40, 0x00, 0x00} // 6c l
-  ,{0x7c, 0x04, 0x18, 0x04, 0x78, 0x00} // 6d m
-  ,{0x7c, 0x08, 0x04, 0x04, 0x78, 0x00} // 6e n
-  ,{0x38, 0x44, 0x44, 0x44, 0x38, 0x00} // 6f o
-  ,{0x7c, 0x14, 0x14, 0x14, 0x08, 0x00} // 70 p
-  ,{0x08, 0x14, 0x14, 0x18, 0x7c, 0x00} // 71 q
-  ,{0x7c, 0x08, 0x04, 0x04, 0x08, 0x00} // 72 r
-  ,{0x48, 0x54, 0x54, 0x54, 0x20, 0x00} // 73 s
-  ,{0x04, 0x3f, 0x44, 0x40, 0x20, 0x00} // 74 t
-  ,{0x3c, 0x40, 0x40, 0x20, 0x7c, 0x00} // 75 u
-  ,{0x1c, 0x20, 0x40, 0x20, 0x1c, 0x00} // 76 v
-  ,{0x3c, 0x40, 0x30, 0x40, 0x3c, 0x00} // 77 w
-  ,{0x44, 0x28, 0x10, 0x28, 0x44, 0x00} // 78 x
-  ,{0x0c, 0x50, 0x50, 0x50, 0x3c, 0x00} // 79 y
-  ,{0x44, 0x64, 0x54, 0x4c, 0x44, 0x00} // 7a z
-  ,{0x00, 0x08, 0x36, 0x41, 0x00, 0x00} // 7b {
-  ,{0x00, 0x00, 0x7f, 0x00, 0x00, 0x00} // 7c |
-  ,{0x00, 0x41, 0x36, 0x08, 0x00, 0x00} // 7d }
-  ,{0x10, 0x08, 0x08, 0x10, 0x08, 0x00} // 7e ~
-//  ,{0x78, 0x46, 0x41, 0x46, 0x78, 0x00} // 7f DEL
-  ,{0x1f, 0x24, 0x7c, 0x24, 0x1f, 0x00} // 7f UT sign
+  ASCII6_TABLE(ASCII6_GLYPH)
+};
+
+#if NOKIA5110EMU_GLYPH_ATLAS
+// The same font expanded by the preprocessor into the exact bytes sent to
+// the LCD for a 6x8 character window, one row of three pixel pairs at a time
+#define GLYPH_PIXEL(C, ROW) ((((C)>>(ROW))&1) ? PIXEL_ON : PIXEL_OFF)
+#define GLYPH_ROW(C0, C1, C2, C3, C4, C5, ROW) \
+  PIXEL_PAIR_BYTES(GLYPH_PIXEL(C0, ROW), GLYPH_PIXEL(C1, ROW)), \
+  PIXEL_PAIR_BYTES(GLYPH_PIXEL(C2, ROW), GLYPH_PIXEL(C3, ROW)), \
+  PIXEL_PAIR_BYTES(GLYPH_PIXEL(C4, ROW), GLYPH_PIXEL(C5, ROW))
+#define ASCII6_ATLAS_GLYPH(C0, C1, C2, C3, C4, C5) { \
+  GLYPH_ROW(C0, C1, C2, C3, C4, C5, 0), GLYPH_ROW(C0, C1, C2, C3, C4, C5, 1), \
+  GLYPH_ROW(C0, C1, C2, C3, C4, C5, 2), GLYPH_ROW(C0, C1, C2, C3, C4, C5, 3), \
+  GLYPH_ROW(C0, C1, C2, C3, C4, C5, 4), GLYPH_ROW(C0, C1, C2, C3, C4, C5, 5), \
+  GLYPH_ROW(C0, C1, C2, C3, C4, C5, 6), GLYPH_ROW(C0, C1, C2, C3, C4, C5, 7) },
+#define GLYPH_ROW_BYTES (CHAR_WIDTH*3/2)
+static const uint8_t ASCII6_atlas[][CHAR_HEIGHT*GLYPH_ROW_BYTES] = {
+  ASCII6_TABLE(ASCII6_ATLAS_GLYPH)
+};
+#endif
+#if !NOKIA5110EMU_SSI_12BIT || NOKIA5110EMU_DMA || NOKIA5110EMU_GLYPH_ATLAS
+// Packed pixel data for every combination of two pixels, bit 0 is the first
+static const uint8_t LCD_pixel_pair[4][3] = {
+   PIXEL_PAIR(PIXEL_OFF, PIXEL_OFF)
+  ,PIXEL_PAIR(PIXEL_ON,  PIXEL_OFF)
+  ,PIXEL_PAIR(PIXEL_OFF, PIXEL_ON)
+  ,PIXEL_PAIR(PIXEL_ON,  PIXEL_ON)
+};
+#endif
+#if NOKIA5110EMU_UPSCALE
+// Column of each group of LCD_SCALE_IN columns shown by each of the
+// LCD_SCALE_OUT LCD columns it is stretched over, every other one is doubled
+static const uint8_t LCD_scale_col[LCD_SCALE_OUT] = { 0, 0, 1, 2, 2, 3 };
+// Row of a bank shown by each of the LCD_BANK_ROWS LCD rows it is stretched over
+static const uint8_t LCD_scale_row[LCD_BANK_ROWS] = {
+#if NOKIA5110EMU_UPSCALE == 1
+  0, 0, 1, 2, 2, 3, 4, 4, 5, 6, 6, 7
+#else
+  0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7
+#endif
 };
+#endif
 // LCD RAM data window data 
-static uint8_t LCD_cursor_x;
-static uint8_t LCD_cursor_y;
 static uint8_t LCD_window_x;
 static uint8_t LCD_window_width;
 static uint8_t LCD_window_y;
 static uint8_t LCD_window_height;
-static uint8_t char_spacing;
+static uint32_t SPI_clock_hz; // current SSI2 bit rate
+#if NOKIA5110EMU_HOST
+// What the SSI2 and GPIO hardware would hold on the TM4C123
+static uint8_t LCD_host_rs;              // level of the RS line
+static uint8_t LCD_host_bits = 8;        // SSI2 frame size
+static uint32_t LCD_host_cycles;         // stands in for DWT_CYCCNT_R
+static uint32_t LCD_host_fraction;       // part of a cycle left over, in 1/SPI_clock_hz
+#if NOKIA5110EMU_STATS || NOKIA5110EMU_NATIVE_FRAMES
+static uint32_t LCD_host_debug[2];       // stand in for DEMCR_R and DWT_CTRL_R
+#endif
+#endif
+
+// Everything about one virtual Nokia5110 display on the ST7735, display 0
+// is the emulator window drawn from Screen
+struct LCD_context
+{
+  // Copy of the display contents as last sent to the ST7735 in the same bank
+  // layout as Screen, used to send only the parts of a new frame which changed
+  // Word aligned so whole words of each bank can be compared
+  char shadow[SCREENW*SCREENH/8] __attribute__ ((aligned(4)));
+  char *buffer;          // frame sent by Nokia5110Emu_FlushDisplays, 0 until opened
+  uint8_t x, y;          // ST7735 pixel at the top left corner
+  uint8_t cursor_x;
+  uint8_t cursor_y;
+  uint8_t spacing;       // blank columns between characters
+  uint8_t shadow_valid;  // 0 until the display has been fully written once
+};
+static struct LCD_context LCD_context[NOKIA5110EMU_DISPLAYS];
+// The display the text and drawing functions draw on
+static struct LCD_context *LCD_ctx = &LCD_context[0];
+#if NOKIA5110EMU_DISPLAYS > 1
+// One bank of one display in the order they appear down the ST7735, with the
+// columns which changed since it was last sent
+struct LCD_slot
+{
+  struct LCD_context *ctx;
+  uint8_t bank;
+  uint8_t dirty;
+  uint16_t first;
+  uint16_t last;
+};
+// Bytes sent to open a window, CASET, RASET and RAMWR with their parameters
+#define LCD_WINDOW_BYTES 11
+// Draw on display 0 whichever display is selected, for the functions which
+// send Screen or frames handed over for it
+#define LCD_DEFAULT_BEGIN() struct LCD_context *LCD_saved_ctx = LCD_ctx; LCD_ctx = &LCD_context[0]
+#define LCD_DEFAULT_END()   (LCD_ctx = LCD_saved_ctx)
+#else
+#define LCD_DEFAULT_BEGIN()
+#define LCD_DEFAULT_END()
+#endif
+#if NOKIA5110EMU_SCROLL
+// Row of LCD memory and the shadow copy shown at the top of the emulator
+// window, the shadow copy is kept in the same order as LCD memory
+static uint8_t LCD_scroll_y;
+#endif
+
+#if NOKIA5110EMU_STATS
+static struct Nokia5110Emu_Stats LCD_stats;
+static struct Nokia5110Emu_Stats LCD_stats_last; // counters when last drawn
+static uint32_t LCD_stats_time;                 // cycle count when last drawn
+#endif
+
+#if NOKIA5110EMU_TRACE
+// One transaction sent to the ST7735, or queued for it with
+// NOKIA5110EMU_TX_QUEUE or NOKIA5110EMU_DMA
+struct LCD_trace_entry
+{
+  uint32_t time;   // cycle count when it started
+  uint32_t wait;   // cycles spent waiting for the SSI while sending it
+  uint16_t bytes;  // bytes sent, including any command parameters
+  uint8_t type;    // LCD_TRACE_COMMAND, _WINDOW, _DATA or _MARK
+  uint8_t code;    // command or mark tag
+  uint8_t x, y;    // ST7735 window the data is written to
+  uint8_t width, height;
+};
+static struct LCD_trace_entry LCD_trace[NOKIA5110EMU_TRACE_SIZE];
+static volatile uint32_t LCD_trace_next;  // transactions since the trace was cleared
+static volatile uint8_t LCD_trace_paused; // 1 while Nokia5110Emu_TraceDump sends it
+static uint8_t LCD_trace_window[4];       // x, y, width and height last set
+#endif
+
+#if NOKIA5110EMU_BENCHMARK
+// Set by Nokia5110Emu_Benchmark to time LCD_stream_region in place of the
+// streaming kernels
+static uint8_t LCD_bench_generic;
+#define LCD_KERNELS_ON() (!LCD_bench_generic)
+#else
+#define LCD_KERNELS_ON() 1
+#endif
+
+#if NOKIA5110EMU_MIRROR
+// The UART0 interrupt is number 5
+#define LCD_MIRROR_INT_B  BIT(5)
+// Bytes of a packet before its runs, and the longest packet: changing every
+// other byte costs three bytes for two and the checksum follows the runs
+#define LCD_MIRROR_HEADER 5
+#define LCD_MIRROR_PACKET (LCD_MIRROR_HEADER + SCREENW*SCREENH/8*3/2 + 1)
+// Shortest repeat worth a fill run in the middle of literal bytes
+#define LCD_MIRROR_FILL_MIN 3
+static char LCD_mirror_copy[SCREENW*SCREENH/8] __attribute__ ((aligned(4))); // what the viewer shows
+static uint8_t LCD_mirror_packet[LCD_MIRROR_PACKET];
+static uint16_t LCD_mirror_length;           // bytes in the packet
+static uint16_t LCD_mirror_sent;             // bytes of it written to UART0
+static uint8_t LCD_mirror_sequence;
+static volatile uint8_t LCD_mirror_changed;  // display 0 changed since the packet was encoded
+static volatile uint8_t LCD_mirror_key;      // the next packet is a key frame
+// Let UART0_Handler know display 0 has changed, it runs as soon as
+// nothing more important is running
+#define LCD_MIRROR_KICK()    do { LCD_mirror_changed = 1; NVIC_PEND0_R = LCD_MIRROR_INT_B; } while(0)
+#define LCD_MIRROR_CHANGED() do { if ( LCD_ctx == &LCD_context[0] ) LCD_MIRROR_KICK(); } while(0)
+#else
+#define LCD_MIRROR_KICK()
+#define LCD_MIRROR_CHANGED()
+#endif
+
+#if NOKIA5110EMU_DMA
+// uDMA channel 13 (encoding 2) is the SSI2 transmit channel
+#define LCD_DMA_CHANNEL 13
+// The SSI2 interrupt is number 57
+#define LCD_DMA_INT_B   BIT(57-32)
+// Pixel data for one changed bank span of the emulator window. One full width
+// bank is 84x8 pixels = 1008 bytes which fits in a single 1024 item transfer,
+// a scaled bank does not so its spans are split into regions of no more than
+// LCD_DMA_SPAN columns
+#define LCD_DMA_SPAN    (1024/(LCD_SCALE_OUT*LCD_BANK_ROWS*3/2)*LCD_SCALE_IN < SCREENW ? \
+                         1024/(LCD_SCALE_OUT*LCD_BANK_ROWS*3/2)*LCD_SCALE_IN : SCREENW)
+#define LCD_DMA_REGIONS (NOKIA5110EMU_DISPLAYS*SCREENH/8*((SCREENW + LCD_DMA_SPAN - 1)/LCD_DMA_SPAN))
+struct LCD_region
+{
+  uint8_t bank;
+  uint8_t first;
+  uint8_t last;
+  uint8_t solid;   // 1 to send pattern for every byte instead of expanding
+  uint8_t pattern; // the byte every pixel pair of a solid region packs to
+  uint8_t display; // display whose shadow copy the region is sent from
+  uint8_t rows;    // rows of the window opened for it, 0 to carry on the last one
+#if NOKIA5110EMU_NATIVE_FRAMES
+  const uint8_t *packed; // pixel data already packed, sent from here instead
+#endif
+};
+static struct LCD_region LCD_dma_region[LCD_DMA_REGIONS];
+static volatile uint8_t LCD_dma_count;   // number of regions in this update
+static volatile uint8_t LCD_dma_next;    // region currently being transferred
+static volatile uint8_t LCD_dma_busy;    // 1 until the last region has been sent
+static void (*LCD_dma_callback)(void);   // called from SSI2_Handler when done
+// Two buffers so the next region can be expanded while the current one is sent
+static uint8_t LCD_dma_buffer[2][LCD_SCALE_X(LCD_DMA_SPAN)*LCD_BANK_ROWS*3/2];
+// uDMA channel control table only the primary structures are used, but the
+// table must be aligned on a 1024 byte boundary
+static uint32_t LCD_dma_table[128] __attribute__ ((aligned(1024)));
+#endif
+
+#if NOKIA5110EMU_ASYNC_INIT
+// The Timer5A interrupt steps through the LCD bring-up one state at a time
+// and the first emulator call after LCD_BOOT_SHOW draws the window
+#define LCD_BOOT_WAKE      0 // reset asserted, release it and wait 150ms
+#define LCD_BOOT_SLEEP_OUT 1 // send SLPOUT and wait 120ms
+#define LCD_BOOT_CONFIGURE 2 // send the panel settings and DISPON, wait 1ms
+#define LCD_BOOT_FORMAT    3 // set the pixel format and streaming SSI clock
+#define LCD_BOOT_PATTERN   4 // fill the display with the RGB pattern
+#define LCD_BOOT_SHOW      5 // waiting for the labels and window to be drawn
+#define LCD_BOOT_READY     6 // drawing goes straight to the LCD
+// Rows of the RGB pattern sent by each Timer5A interrupt
+#define LCD_BOOT_ROWS      8
+static volatile uint8_t LCD_boot_state;
+#if NOKIA5110EMU_FAST_BOOT == 0
+static uint8_t LCD_boot_row;       // next row of the RGB pattern
+#endif
+static uint32_t LCD_boot_spi_hz;   // streaming SSI clock rate once initialised
+#endif
+#if NOKIA5110EMU_ASYNC_INIT || NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE
+// The Timer5A interrupt is number 92
+#define LCD_TIMER_INT_B    BIT(92-64)
+#endif
+
+#if NOKIA5110EMU_FRAME_PACING
+// Panel refresh rate set by FRMCTR1 in LCD_configure
+// Frame rate=fosc/((RTNA + 20) x (LINE + FPA + BPA)), about 63Hz
+#define ST7735_FOSC_HZ     333000
+#define ST7735_LINES       160
+#define LCD_PANEL_HZ       (ST7735_FOSC_HZ/((0x01 + 20)*(ST7735_LINES + 0x2c + 0x2d)))
+// The latest frame presented, sent to the LCD by the next Timer5A tick
+static char LCD_pace_frame[SCREENW*SCREENH/8] __attribute__ ((aligned(4)));
+static volatile uint8_t LCD_pace_pending;
+static uint8_t LCD_pace_running;   // Timer5A is ticking at LCD_pace_hz
+static uint32_t LCD_pace_hz;       // 0 until Nokia5110Emu_SetFrameRate
+static struct Nokia5110Emu_PaceStats LCD_pace_stats;
+#endif
+
+#if NOKIA5110EMU_POWER_SAVE
+// SLPIN and SLPOUT must be at least 120ms apart
+#define ST7735_SLEEP_MS    120
+// Longest sleep timeout Timer5A can count
+#define LCD_SLEEP_MAX_MS   (0xFFFFFFFF/(SYSTEM_CLOCK_HZ/1000))
+static uint8_t LCD_power_modes;      // NOKIA5110EMU_POWER_ modes in use
+static uint32_t LCD_power_ms;        // sleep timeout, 0 to never sleep
+static volatile uint8_t LCD_asleep;  // SLPIN sent and nothing drawn since
+static uint32_t LCD_asleep_time;     // cycle counter when SLPIN was sent
+#if NOKIA5110EMU_FRAME_PACING
+static uint32_t LCD_power_ticks;     // frame pacing ticks without drawing
+#endif
+#endif
+
+#if NOKIA5110EMU_UPSCALE
+// Text in the emulator window is drawn scaled from the shadow copy by
+// LCD_update_shadow, labels around it are written straight to the LCD
+#define LCD_DIRECT_TEXT()   (!LCD_ctx->shadow_valid)
+#else
+#define LCD_DIRECT_TEXT()   1
+#endif
+
+#if NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE
+// Keep Timer5A from drawing while the application is drawing. Locks nest,
+// only the outermost unlock puts back the enable it found, so drawing
+// functions can call each other and nothing turns Timer5A on before
+// Initialize_Timer5 has set it up
+static uint8_t LCD_timer_depth;      // number of locks held
+static uint32_t LCD_timer_enabled;   // Timer5A NVIC enable at the first lock
+#define LCD_TIMER_LOCK()    do { if ( LCD_timer_depth++ == 0 ) { \
+      LCD_timer_enabled = NVIC_EN2_R & LCD_TIMER_INT_B; NVIC_DIS2_R = LCD_TIMER_INT_B; } } while(0)
+#define LCD_TIMER_UNLOCK()  do { if ( --LCD_timer_depth == 0 && LCD_timer_enabled ) \
+      NVIC_EN2_R = LCD_TIMER_INT_B; } while(0)
+#else
+#define LCD_TIMER_LOCK()
+#define LCD_TIMER_UNLOCK()
+#endif
+
+#if NOKIA5110EMU_TX_QUEUE
+// Ring buffer of entries waiting to be sent, added at head by the drawing
+// functions and removed at tail by SSI2_Handler
+static volatile uint16_t LCD_txq[NOKIA5110EMU_TXQ_SIZE];
+static volatile uint16_t LCD_txq_head;
+static volatile uint16_t LCD_txq_tail;
+static uint16_t LCD_txq_line;  // RS level and frame size SSI2 is set up for
+static uint16_t LCD_txq_frame; // LCD_TXQ_WIDE while sending 12-bit pixels
+#endif
+
+#if NOKIA5110EMU_PCD8544
+// PCD8544 commands, which bits are used depends on H in the function set
+#define PCD8544_FUNCTION   0x20 // 0010 0PVH power down, vertical addressing, extended
+#define PCD8544_FUNCTION_V 0x02
+#define PCD8544_FUNCTION_H 0x01
+#define PCD8544_SET_Y      0x40 // 0100 0YYY with H = 0
+#define PCD8544_SET_X      0x80 // 1XXX XXXX with H = 0, Vop with H = 1
+// The PCD8544 address counter and function set
+static uint8_t LCD_pcd_x;
+static uint8_t LCD_pcd_y;
+static uint8_t LCD_pcd_function;
+// Columns of each bank of the shadow copy written since the last flush, from
+// first to one before end, end is 0 when nothing has been written
+static uint8_t LCD_pcd_first[SCREENH/8];
+static uint8_t LCD_pcd_end[SCREENH/8];
+static uint8_t LCD_pcd_dirty;      // something is waiting to be flushed
+#endif
+
+#if NOKIA5110EMU_SERVER
+// One request to the display server. Text requests carry their own cursor
+// position so threads drawing in different places do not disturb each other
+#define LCD_REQ_STRING 0
+#define LCD_REQ_CLEAR  1
+#define LCD_REQ_FRAME  2
+#define LCD_REQ_TEXT   16   // longest string request including the 0
+struct LCD_request
+{
+  volatile uint8_t ready;   // set once the producer has filled in the slot
+  uint8_t type;
+  uint8_t x, y;             // text cursor
+  char text[LCD_REQ_TEXT];
+};
+// Producers reserve slots at head inside a short critical section and fill
+// them in afterwards, only the server thread moves tail on
+static struct LCD_request LCD_server_slot[NOKIA5110EMU_SERVER_SLOTS];
+static volatile uint16_t LCD_server_head;
+static volatile uint16_t LCD_server_tail;
+// The latest frame posted, shown by the next LCD_REQ_FRAME request
+static char LCD_server_frame[SCREENW*SCREENH/8];
+static char LCD_server_back[SCREENW*SCREENH/8] __attribute__ ((aligned(4))); // copy being sent
+#endif
+
+#if NOKIA5110EMU_DOUBLE_BUFFER
+// Front buffer holding a frame flipped from Screen while the previous frame
+// was still being sent, SSI2_Handler starts it as soon as the LCD is free
+static char LCD_front[SCREENW*SCREENH/8] __attribute__ ((aligned(4)));
+static volatile uint8_t LCD_front_pending;
+#endif
 
 // Declare the Global screen buffer originally defined in Nokia 5110.c
-char Screen[SCREENW*SCREENH/8]; // buffer stores the next image to be printed on the screen
+char Screen[SCREENW*SCREENH/8] __attribute__ ((aligned(4))); // buffer stores the next image to be printed on the screen
 
 /**************************** Code *******************************************/
 
@@ -263,25 +1302,42 @@ char Screen[SCREENW*SCREENH/8]; // buffer stores the next image to be printed on
 // Notes:   assumes 80 MHz clock
 static void delay(unsigned long msec)
 {
+#if NOKIA5110EMU_HOST
+	  // count the time without waiting for it
+	  LCD_host_cycles += msec*(SYSTEM_CLOCK_HZ/1000);
+#else
 	  unsigned long j;
 	  while (msec-- > 0)
 				for (j=6000; j>0; j--);
+#endif
 }
 
+#if !NOKIA5110EMU_TX_QUEUE
 //============================================================================
 // Send one byte over Hardware SPI
 static void SPI_transfer(uint8_t byte)
 {
+    // commands and parameters are always 8-bit frames
+    SPI_setFrame(SSI_CR0_DSS_8);
     // wait until SSI2 not busy/transmit FIFO empty
-    while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
-    SSI2_DR_R = byte; // send a byte
+    SSI2_WAIT_IDLE();
+    SSI2_WRITE(byte); // send a byte
+    LCD_STAT(command_bytes, 1);
     // wait until SSI2 not busy/transmit FIFO empty
-    while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
+    SSI2_WAIT_IDLE();
 }
+#endif
 //============================================================================
 // Send a command on Hardware SPI
 static void SPI_sendCommand(uint8_t command)
 {
+#if NOKIA5110EMU_TRACE
+  LCD_trace_command(command, 1);
+#endif
+#if NOKIA5110EMU_TX_QUEUE
+  LCD_STAT(command_bytes, 1);
+  LCD_txq_put(command);
+#else
   // Select the LCD's command register
   CLR_RS;
   // Select the LCD controller
@@ -290,11 +1346,19 @@ static void SPI_sendCommand(uint8_t command)
   SPI_transfer(command);
   // Deselect the LCD controller
   CLR_CS;
+#endif
 }
 //============================================================================
 // Send data on Hardware SPI
 static void SPI_sendData(uint8_t data)
 {
+#if NOKIA5110EMU_TRACE
+  LCD_trace_command(data, 0);
+#endif
+#if NOKIA5110EMU_TX_QUEUE
+  LCD_STAT(command_bytes, 1);
+  LCD_txq_put(LCD_TXQ_DATA|data);
+#else
   // Select the LCD's data register
   SET_RS;
   // Select the LCD controller
@@ -303,8 +1367,181 @@ static void SPI_sendData(uint8_t data)
   SPI_transfer(data);
   // Deselect the LCD controller
   CLR_CS;
+#endif
 }
 
+#if NOKIA5110EMU_SSI_12BIT
+//============================================================================
+// Set the SSI2 data size to 8-bit (SSI_CR0_DSS_8) or 12-bit (SSI_CR0_DSS_12)
+// frames, waiting for any data already in the FIFO to be sent first
+static void SPI_setFrame(uint32_t dss)
+{
+#if NOKIA5110EMU_TX_QUEUE
+  // tag the pixels which follow, SSI2_Handler changes the frame size
+  LCD_txq_frame = (dss == SSI_CR0_DSS_12) ? LCD_TXQ_WIDE : 0;
+#elif NOKIA5110EMU_HOST
+  LCD_host_bits = (dss == SSI_CR0_DSS_12) ? 12 : 8;
+#else
+  if ( (SSI2_CR0_R&SSI_CR0_DSS_M) != dss )
+  {
+    SSI2_WAIT_IDLE();
+    SSI2_CR1_R &= ~SSI_CR1_SSE;         // disable SSI2
+    SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_DSS_M)+dss;
+    SSI2_CR1_R |= SSI_CR1_SSE;          // enable SSI2
+  }
+#endif
+}
+#endif
+
+//============================================================================
+// Set the SSI2 bit rate to the fastest rate no faster than hz which the
+// clock dividers can make, limited to what the SSI and ST7735 allow
+// SSI2 must be not busy and disabled when this is called
+// Returns the actual bit rate
+static uint32_t SPI_setClock(uint32_t hz)
+{
+  uint32_t best = 0, cpsdvsr, scr, rate;
+  uint32_t best_cpsdvsr = 254, best_scr = 255;
+  if ( hz == 0 || hz > ST7735_MAX_SPI_HZ )
+    hz = ST7735_MAX_SPI_HZ;
+  if ( hz > SSI_MAX_MASTER_HZ )
+    hz = SSI_MAX_MASTER_HZ;
+  // SysClk/(CPSDVSR*(1+SCR)) where CPSDVSR is even from 2 to 254
+  for (cpsdvsr = 2; cpsdvsr <= 254; cpsdvsr += 2)
+  {
+    // smallest SCR giving a rate no faster than hz
+    scr = (SYSTEM_CLOCK_HZ + cpsdvsr*hz - 1)/(cpsdvsr*hz);
+    scr = scr ? scr - 1 : 0;
+    if ( scr > 255 )
+      continue;
+    rate = SYSTEM_CLOCK_HZ/(cpsdvsr*(1+scr));
+    if ( rate > best )
+    {
+      best = rate;
+      best_cpsdvsr = cpsdvsr;
+      best_scr = scr;
+    }
+  }
+  if ( best == 0 ) // hz is too slow so use the slowest rate
+    best = SYSTEM_CLOCK_HZ/(254*256);
+#if !NOKIA5110EMU_HOST
+  SSI2_CPSR_R = (SSI2_CPSR_R&~SSI_CPSR_CPSDVSR_M)+best_cpsdvsr; // must be even number
+  SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_SCR_M)+(best_scr<<8);
+#else
+  // the host only needs the rate to time the frames
+  (void)best_cpsdvsr;
+  (void)best_scr;
+#endif
+  SPI_clock_hz = best;
+  return best;
+}
+
+//============================================================================
+// Change the SSI2 bit rate once everything already sent or queued has gone
+// Returns the actual bit rate
+static uint32_t SPI_changeClock(uint32_t hz)
+{
+  uint32_t rate;
+#if NOKIA5110EMU_DMA
+  LCD_dma_wait();
+#endif
+#if NOKIA5110EMU_TX_QUEUE
+  LCD_txq_wait();
+#endif
+  SSI2_WAIT_IDLE();
+#if NOKIA5110EMU_HOST
+  rate = SPI_setClock(hz);
+#else
+  SSI2_CR1_R &= ~SSI_CR1_SSE;           // disable SSI2
+  rate = SPI_setClock(hz);
+  SSI2_CR1_R |= SSI_CR1_SSE;            // enable SSI2
+#endif
+  return rate;
+}
+
+#if NOKIA5110EMU_HOST
+//============================================================================
+// Pass one SSI2 frame to the host and count the time it takes at the
+// current bit rate
+static void LCD_host_send(uint16_t value)
+{
+  uint64_t time = (uint64_t)LCD_host_bits*SYSTEM_CLOCK_HZ + LCD_host_fraction;
+  LCD_host_cycles += time/SPI_clock_hz;
+  LCD_host_fraction = time%SPI_clock_hz;
+  Nokia5110Emu_HostWrite(LCD_host_rs, value, LCD_host_bits);
+}
+#endif
+
+#if NOKIA5110EMU_TX_QUEUE
+//============================================================================
+// Add one entry to the transmit queue, waiting only if it is full
+static void LCD_txq_put(uint16_t entry)
+{
+  uint16_t head = LCD_txq_head;
+  uint16_t next = (head + 1)&(NOKIA5110EMU_TXQ_SIZE-1);
+  while (next == LCD_txq_tail) {}; // wait for SSI2_Handler to make room
+  LCD_txq[head] = entry;
+  LCD_txq_head = next;
+  SSI2_IM_R = SSI_IM_TXIM;         // interrupt when the FIFO is half empty
+}
+
+//============================================================================
+// Add count entries to the transmit queue together, waiting once for room
+// for all of them so a whole command sequence is queued in one go
+static void LCD_txq_write(const uint16_t* entries, uint16_t count)
+{
+  uint16_t head = LCD_txq_head;
+  while (((LCD_txq_tail - head - 1)&(NOKIA5110EMU_TXQ_SIZE-1)) < count) {};
+  while (count--)
+  {
+    LCD_txq[head] = *entries++;
+    head = (head + 1)&(NOKIA5110EMU_TXQ_SIZE-1);
+  }
+  LCD_txq_head = head;
+  SSI2_IM_R = SSI_IM_TXIM;
+}
+
+//============================================================================
+// Wait until everything in the transmit queue has been sent
+static void LCD_txq_wait(void)
+{
+  while (LCD_txq_head != LCD_txq_tail) {};
+  SSI2_WAIT_IDLE();
+}
+
+//============================================================================
+// SSI2 transmit FIFO half empty interrupt
+// Moves entries from the transmit queue to the FIFO until it is full. RS and
+// the frame size are only changed once everything before has been sent
+void SSI2_Handler(void)
+{
+  uint16_t tail = LCD_txq_tail, head = LCD_txq_head;
+  while ( tail != head && (SSI2_SR_R&SSI_SR_TNF) )
+  {
+    uint16_t entry = LCD_txq[tail];
+    if ( (entry^LCD_txq_line)&LCD_TXQ_MODE )
+    {
+      SSI2_WAIT_IDLE();
+      if ( entry&LCD_TXQ_DATA )
+        SET_RS;
+      else
+        CLR_RS;
+#if NOKIA5110EMU_SSI_12BIT
+      SSI2_CR1_R &= ~SSI_CR1_SSE;       // disable SSI2
+      SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_DSS_M)+((entry&LCD_TXQ_WIDE) ? SSI_CR0_DSS_12 : SSI_CR0_DSS_8);
+      SSI2_CR1_R |= SSI_CR1_SSE;        // enable SSI2
+#endif
+      LCD_txq_line = entry&LCD_TXQ_MODE;
+    }
+    SSI2_DR_R = entry&LCD_TXQ_VALUE;
+    tail = (tail + 1)&(NOKIA5110EMU_TXQ_SIZE-1);
+  }
+  LCD_txq_tail = tail;
+  if ( tail == head )
+    SSI2_IM_R = 0;                      // nothing left to send
+}
+#endif
+
 //----------------------------------------------------------------------------
 // Defines for the ST7735 registers. Unused commands are commented out
 // ref: https://www.crystalfontz.com/products/document/3277/ST7735_V2.1_20100505.pdf
@@ -319,12 +1556,12 @@ static void SPI_sendData(uint8_t data)
 #define ST7735_RDDCOLMOD (0x0C) // Read Display Pixel Format
 #define ST7735_RDDIM    (0x0D) // Read Display Image Mode
 #define ST7735_RDDSM    (0x0E) // Read Display Signal Mode
-#define ST7735_RDDSR    (0x0F) // Read Display Self-Diagnostic Result
-#define ST7735_SLPIN    (0x10) // Sleep In & Booster Off */
+#define ST7735_RDDSR    (0x0F) // Read Display Self-Diagnostic Result */
+#define ST7735_SLPIN    (0x10) // Sleep In & Booster Off
 #define ST7735_SLPOUT   (0x11) // Sleep Out & Booster On
-#define ST7735_PTLON    (0x12) /* Partial Mode On 
+#define ST7735_PTLON    (0x12) // Partial Mode On
 #define ST7735_NORON    (0x13) // Partial Mode Off (Normal)
-#define ST7735_INVOFF   (0x20) // Diplay Inversion Off (Normal)
+#define ST7735_INVOFF   (0x20) /* Diplay Inversion Off (Normal)
 #define ST7735_INVON    (0x21) // Display Inversion On
 #define ST7735_GAMSET   (0x26) // Gamma Curve Select */
 #define ST7735_DISPOFF  (0x28) // Display Off
@@ -334,14 +1571,14 @@ static void SPI_sendData(uint8_t data)
 #define ST7735_RAMWR    (0x2C) /* Memory Write
 #define ST7735_RGBSET   (0x2D) // LUT for 4k,65k,262k colour display */
 #define ST7735_RAMRD    (0x2E) // Memory Read
-#define ST7735_PTLAR    (0x30) /* Partial Start/End Address
-#define ST7735_SCRLAR   (0x33) // Scroll Area Set */
+#define ST7735_PTLAR    (0x30) // Partial Start/End Address
+#define ST7735_SCRLAR   (0x33) // Scroll Area Set
 #define ST7735_TEOFF    (0x34) // Tearing Effect Line Off
 #define ST7735_TEON     (0x35) // Tearing Effect Mode Set & On
-#define ST7735_MADCTL   (0x36) /* Memory Data Acess Control
+#define ST7735_MADCTL   (0x36) // Memory Data Acess Control
 #define ST7735_VSCSAD   (0x37) // Scroll Start Address of RAM
 #define ST7735_IDMOFF   (0x38) // Idle Mode Off
-#define ST7735_IDMON    (0x39) // Idle Mode On */
+#define ST7735_IDMON    (0x39) // Idle Mode On
 #define ST7735_COLMOD   (0x3A) /* Interface Pixel Format
 #define ST7735_RDID1    (0xDA) // Read ID1
 #define ST7735_RDID2    (0xDB) // Read ID2
@@ -383,6 +1620,16 @@ void Initialize_LCD(void)
   SPI_sendCommand(ST7735_SLPOUT);
   delay(120);
 
+  LCD_configure();
+  delay(1);
+  LCD_set_format();
+}
+
+//----------------------------------------------------------------------------
+// Send the ST7735 panel settings and switch the display on
+// The LCD must have been out of sleep mode for 120ms
+static void LCD_configure(void)
+{
   //FRMCTR1 (B1h): Frame Rate Control (In normal mode/ Full colors)
   //Set the frame frequency of the full colors normal mode.
   // * Frame rate=fosc/((RTNA + 20) x (LINE + FPA + BPA))
@@ -399,9 +1646,16 @@ void Initialize_LCD(void)
   // * 1 < FPB(front porch) + BPB(back porch) ; Back porch ?0
   //Note: fosc = 333kHz
   SPI_sendCommand(ST7735_FRMCTR2);//In Idle mode (8-colors)
+#if NOKIA5110EMU_POWER_SAVE
+  // Slowest idle mode refresh, 333K/((15 + 20) x (160 + 63 + 63)) = 33Hz
+  SPI_sendData(0x0f);//RTNB: set 1-line period
+  SPI_sendData(0x3f);//FPB:  front porch
+  SPI_sendData(0x3f);//BPB:  back porch
+#else
   SPI_sendData(0x01);//RTNB: set 1-line period
   SPI_sendData(0x2c);//FPB:  front porch
   SPI_sendData(0x2d);//BPB:  back porch
+#endif
 
   //FRMCTR3 (B3h): Frame Rate Control (In Partial mode/ full colors)
   //Set the frame frequency of the Partial mode/ full colors.
@@ -653,8 +1907,13 @@ void Initialize_LCD(void)
   // * This command does not change any other status.
   // * The delay time between DISPON and DISPOFF needs 120ms at least
   SPI_sendCommand(ST7735_DISPON); //Display On
-  delay(1);
+}
 
+//----------------------------------------------------------------------------
+// Set the ST7735 memory access order and 12-bit pixel format
+// Sent 1ms after the display was switched on
+static void LCD_set_format(void)
+{
   //MADCTL (36h): Memory Data Access Control
   SPI_sendCommand(ST7735_MADCTL);
   SPI_sendData(0xC0);// YXVL RH--
@@ -678,7 +1937,20 @@ void Initialize_LCD(void)
                      // IFPF[2:0] MCU Interface Color Format
                      // IFPF[2:0] | Format
                      //      011b | 12-bit/pixel RRRRGGGG BBBBRRRR GGGGBBBB
+#if NOKIA5110EMU_SCROLL
 
+  //SCRLAR (33h): Scroll Area Set
+  //Only the rows of the emulator window scroll, the rest of the display
+  //is in the top and bottom fixed areas
+  SPI_sendCommand(ST7735_SCRLAR);
+  SPI_sendData(LCD_SCROLL_TFA >> 8);  //TFA[15:8]
+  SPI_sendData(LCD_SCROLL_TFA & 0xFF);//TFA[ 7:0]
+  SPI_sendData(NOKIA_MAX_Y >> 8);     //VSA[15:8]
+  SPI_sendData(NOKIA_MAX_Y & 0xFF);   //VSA[ 7:0]
+  SPI_sendData(LCD_SCROLL_BFA >> 8);  //BFA[15:8]
+  SPI_sendData(LCD_SCROLL_BFA & 0xFF);//BFA[ 7:0]
+  LCD_scroll_to(0);
+#endif
 }
 
 //============================================================================
@@ -688,6 +1960,20 @@ void Initialize_LCD(void)
 //  128x128 for full ST7735 LCD
 //
 static void LCD_resize_window (uint16_t xsize, uint16_t ysize)
+{
+#if NOKIA5110EMU_DMA
+  // the SSI must not be used while pixel data is still being streamed
+  LCD_dma_wait();
+#endif
+  LCD_set_window(LCD_window_x + LCD_ctx->cursor_x, LCD_window_y + LCD_text_row(), xsize, ysize);
+}
+
+//============================================================================
+//
+//  Restrict the LCD data memory which can be written to a window of xsize by
+//  ysize pixels with its top left corner at ST7735 pixel (x,y)
+//
+static void LCD_set_window(uint16_t x, uint16_t y, uint16_t xsize, uint16_t ysize)
 {
 	// window width must be an even number because two adjacent pixels will be written at a time
 	// so stay here forever for debug purposes if xsize is an odd number
@@ -695,7 +1981,35 @@ static void LCD_resize_window (uint16_t xsize, uint16_t ysize)
 	// Store these values as a global to record current window size
   LCD_window_width = xsize;
   LCD_window_height = ysize;
+  LCD_STAT(windows, 1);
+#if NOKIA5110EMU_TRACE
+  LCD_trace_window[0] = x;
+  LCD_trace_window[1] = y;
+  LCD_trace_window[2] = xsize;
+  LCD_trace_window[3] = ysize;
+#endif
+  LCD_TRACE(LCD_TRACE_WINDOW, ST7735_RAMWR, 11);
+#if NOKIA5110EMU_POWER_SAVE
+  // drawing wakes the LCD and starts the sleep timeout again
+  LCD_power_wake();
+  LCD_power_touch();
+#endif
 
+#if NOKIA5110EMU_TX_QUEUE
+  {
+    // Queue CASET, RASET and RAMWR with their parameters as one batch
+    const uint16_t batch[11] = {
+      ST7735_CASET,
+      LCD_TXQ_DATA|((0x00 + x) >> 8), LCD_TXQ_DATA|((0x02 + x) & 0xFF),
+      LCD_TXQ_DATA|((0x00 + x + xsize - 1) >> 8), LCD_TXQ_DATA|((0x02 + x + xsize - 1) & 0xFF),
+      ST7735_RASET,
+      LCD_TXQ_DATA|((0x00 + y) >> 8), LCD_TXQ_DATA|((0x01 + y) & 0xFF),
+      LCD_TXQ_DATA|((0x00 + y + ysize - 1) >> 8), LCD_TXQ_DATA|((0x01 + y + ysize - 1) & 0xFF),
+      ST7735_RAMWR };
+    LCD_STAT(command_bytes, 11);
+    LCD_txq_write(batch, 11);
+  }
+#else
   // CASET (2Ah): Column Address Set
   // * The value of XS [15:0] and XE [15:0] are referred when RAMWR
   //   command comes.
@@ -703,10 +2017,10 @@ static void LCD_resize_window (uint16_t xsize, uint16_t ysize)
   // * XS [15:0] always must be equal to or less than XE [15:0]
   SPI_sendCommand(ST7735_CASET); //Column address set
   // Write the parameters for the "column address set" command
-  SPI_sendData((0x00 + LCD_window_x + LCD_cursor_x) >> 8);                          //Start MSB = XS[15:8]
-  SPI_sendData((0x02 + LCD_window_x + LCD_cursor_x) & 0xFF);                        //Start LSB = XS[ 7:0]
-  SPI_sendData((0x00 + LCD_window_x + LCD_cursor_x + LCD_window_width - 1) >> 8);   //End MSB   = XE[15:8]
-  SPI_sendData((0x02 + LCD_window_x + LCD_cursor_x + LCD_window_width - 1) & 0xFF); //End LSB   = XE[ 7:0]
+  SPI_sendData((0x00 + x) >> 8);                          //Start MSB = XS[15:8]
+  SPI_sendData((0x02 + x) & 0xFF);                        //Start LSB = XS[ 7:0]
+  SPI_sendData((0x00 + x + LCD_window_width - 1) >> 8);   //End MSB   = XE[15:8]
+  SPI_sendData((0x02 + x + LCD_window_width - 1) & 0xFF); //End LSB   = XE[ 7:0]
   // Write the "row address set" command to the LCD
   // RASET (2Bh): Row Address Set
   // * The value of YS [15:0] and YE [15:0] are referred when RAMWR
@@ -715,13 +2029,14 @@ static void LCD_resize_window (uint16_t xsize, uint16_t ysize)
   // * YS [15:0] always must be equal to or less than YE [15:0]
   SPI_sendCommand(ST7735_RASET); //Row address set
   // Write the parameters for the "row address set" command
-  SPI_sendData((0x00 + LCD_window_y + LCD_cursor_y) >> 8);                           //Start MSB = YS[15:8]
-  SPI_sendData((0x01 + LCD_window_y + LCD_cursor_y) & 0xFF);                         //Start LSB = YS[ 7:0]
-  SPI_sendData((0x00 + LCD_window_y + LCD_cursor_y + LCD_window_height - 1) >> 8);   //End MSB   = YE[15:8]
-  SPI_sendData((0x01 + LCD_window_y + LCD_cursor_y + LCD_window_height - 1) & 0xFF); //End LSB   = YE[ 7:0]
+  SPI_sendData((0x00 + y) >> 8);                           //Start MSB = YS[15:8]
+  SPI_sendData((0x01 + y) & 0xFF);                         //Start LSB = YS[ 7:0]
+  SPI_sendData((0x00 + y + LCD_window_height - 1) >> 8);   //End MSB   = YE[15:8]
+  SPI_sendData((0x01 + y + LCD_window_height - 1) & 0xFF); //End LSB   = YE[ 7:0]
   // Prepare the ST7735 LCD to receive pixel data
   // RAMWR (2Ch): Memory Write
   SPI_sendCommand(ST7735_RAMWR); //write data
+#endif
 }
 
 //============================================================================
@@ -730,472 +2045,3800 @@ static void LCD_resize_window (uint16_t xsize, uint16_t ysize)
 //
 static void LCD_reset_window(void)
 {
-	LCD_cursor_x = 0;
-	LCD_cursor_y = 0;
-	LCD_window_x = (ST7735_MAX_X - NOKIA_MAX_X)/2;
-	LCD_window_y = (ST7735_MAX_Y - NOKIA_MAX_Y)/2;
+	LCD_ctx->cursor_x = 0;
+	LCD_ctx->cursor_y = 0;
+	LCD_window_x = LCD_ctx->x;
+	LCD_window_y = LCD_ctx->y;
+#if NOKIA5110EMU_UPSCALE
+  // The scaled window is only sent one bank span at a time, so only the
+  // text area is set here
+#if NOKIA5110EMU_DMA
+  LCD_dma_wait();
+#endif
+  LCD_window_width = NOKIA_MAX_X;
+  LCD_window_height = NOKIA_MAX_Y;
+#else
   LCD_resize_window (NOKIA_MAX_X, NOKIA_MAX_Y);
+#endif
 }
 
+#if NOKIA5110EMU_FAST_BOOT < 2 || NOKIA5110EMU_STATS_OVERLAY
 //============================================================================
 //
-// Write one entire window of data to the LCD
-// If buffer is a null pointer it will fill the window with "off" pixels instead
-// Two pixels of data are processed at a time as 12-bit colour data format combines
-// two 12-bit pixels into three data bytes for speed and efficiency
+//  Print a label at ST7735 pixel (x,y) in the border around the emulator
+//  window, leaving the emulator window and text cursor as they were
 //
-static void LCD_send_data(const char* buffer)
+static void LCD_draw_label(uint16_t x, uint16_t y, const char* label)
 {
-	int i;
-  // Select the LCD's data register
-  SET_RS;
-  // Select the LCD controller
-  CLR_CS;
-	// Send exactly one window of data from buffer
-	for (i=0; i < LCD_window_height * LCD_window_width; i+=2)
-	{
-		unsigned long pixel1, pixel2;
-		// Check single bit of buffer data relating to next pixel
-		if ( buffer && (buffer[i/LCD_window_width/8*LCD_window_width+(i%LCD_window_width)+0] & (1<<(i/LCD_window_width)%8)))
-			pixel1 = PIXEL_ON;
-		else
-			pixel1 = PIXEL_OFF;
-		// Check single bit of buffer data relating to next pixel + 1
-		if ( buffer && (buffer[i/LCD_window_width/8*LCD_window_width+(i%LCD_window_width)+1] & (1<<(i/LCD_window_width)%8)))
-			pixel2 = PIXEL_ON;
-		else
-			pixel2 = PIXEL_OFF;
-		// Send both pixels to LCD over SSI
-		while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
-    SSI2_DR_R = (pixel1&0x0FF0)>>4;                          // Send Red1/Green1 
-		while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
-    SSI2_DR_R = ((pixel1&0x000F)<<4) | ((pixel2&0x0F00)>>8); // Send Blue1/Red2
-		while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
-    SSI2_DR_R = pixel2&0x00FF;                               // Send Green2/Blue2
-	}
-	while((SSI2_SR_R&SSI_SR_BSY)==SSI_SR_BSY){};
-  // De-Select the LCD controller
-  CLR_CS;
+  uint8_t cursor_x = LCD_ctx->cursor_x, cursor_y = LCD_ctx->cursor_y;
+  uint8_t window_x = LCD_window_x, window_y = LCD_window_y;
+  uint8_t width = LCD_window_width, height = LCD_window_height;
+  uint8_t spacing = LCD_ctx->spacing, valid = LCD_ctx->shadow_valid;
+
+  LCD_window_x = 0;
+  LCD_window_y = 0;
+  LCD_window_width = ST7735_MAX_X;
+  LCD_window_height = ST7735_MAX_Y;
+  LCD_ctx->cursor_x = x;
+  LCD_ctx->cursor_y = y;
+  LCD_ctx->spacing = 0;     // Gaps between text look bad outside emulator window
+  LCD_ctx->shadow_valid = 0; // Nothing here is part of the emulator window
+  Nokia5110Emu_OutString((unsigned char *)label);
+
+  LCD_ctx->cursor_x = cursor_x;
+  LCD_ctx->cursor_y = cursor_y;
+  LCD_window_x = window_x;
+  LCD_window_y = window_y;
+  LCD_window_width = width;
+  LCD_window_height = height;
+  LCD_ctx->spacing = spacing;
+  LCD_ctx->shadow_valid = valid;
 }
+#endif
 
+#if NOKIA5110EMU_FAST_BOOT < 2
 //============================================================================
 //
-//  Initialise the SPI specific settings of the launchpad
+//  Print the emulator labels in the border above the emulator window
 //
-void Initialize_SPI(void)
+static void LCD_draw_labels(void)
 {
-	volatile unsigned long temp;
-	// Enable the SSI2 module using the RCGCSSI register (see page 345 of TM4C datasheet).
-	SYSCTL_RCGCSSI_R |= SYSCTL_RCGCSSI_R2; // Enable SSI2 Clock
-	temp = SYSCTL_RCGCSSI_R;
-  // Configure SSI2
-  SSI2_CR1_R &= ~SSI_CR1_SSE;           // disable SSI2
-  SSI2_CR1_R &= ~SSI_CR1_MS;            // master mode
-                                        // configure for system clock/PLL baud clock source
-  SSI2_CC_R = (SSI2_CC_R&~SSI_CC_CS_M)+SSI_CC_CS_SYSPLL;
-                                        // clock divider for 3.125 MHz SSIClk (50 MHz PIOSC/16)
-  SSI2_CPSR_R = (SSI2_CPSR_R&~SSI_CPSR_CPSDVSR_M)+16;
-                                        // clock divider for 8 MHz SSIClk (80 MHz PLL/24)
-                                        // SysClk/(CPSDVSR*(1+SCR))
-                                        // 80/(10*(1+0)) = 8 MHz (slower than 4 MHz)
-  SSI2_CPSR_R = (SSI2_CPSR_R&~SSI_CPSR_CPSDVSR_M)+10; // must be even number
-  SSI2_CR0_R &= ~(SSI_CR0_SCR_M |       // SCR = 0 (8 Mbps data rate)
-                  SSI_CR0_SPH |         // SPH = 0
-                  SSI_CR0_SPO);         // SPO = 0
-                                        // FRF = Freescale format
-  SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_FRF_M)+SSI_CR0_FRF_MOTO;
-                                        // DSS = 8-bit data
-  SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_DSS_M)+SSI_CR0_DSS_8;
-  SSI2_CR1_R |= SSI_CR1_SSE;            // enable SSI2
+	char label1[] = " Nokia 5110 ";
+	char label2[] =  " Emulator ";
+
+	LCD_draw_label((ST7735_MAX_X-12*CHAR_WIDTH)/2,   // Centre 12 chars of label1
+	               LCD_LABEL_Y, label1);              // 3 rows above emulator window
+	LCD_draw_label((ST7735_MAX_X-10*CHAR_WIDTH)/2,   // Centre 10 chars of label2
+	               LCD_LABEL_Y+CHAR_HEIGHT, label2);  // 2 rows above emulator window
 }
+#endif
 
+#if NOKIA5110EMU_FAST_BOOT == 0
 //============================================================================
 //
-//  Initialise the GPIOs on the launchpad used to control the LCD
+//  Send count rows from row first of the RGB pattern which fills the full
+//  128x128 ST7735 display, the window must already be open
 //
-void Initialize_Launchpad()
+static void LCD_send_pattern(uint16_t first, uint16_t count)
 {
-// LCD SPI & control lines
-//      TM4C123G
-//   #31   |  PF4 | LCD_RS
-//   #17   |  PF0 | LCD_RESET
-//   #13   |  PA4 | LCD_CS_NOT (or SPI SS)
-//   #15   |  PB7 | LCD_MOSI (hardware SPI)
-//   #14   |  PB6 | not used (would be MISO)
-//   #7    |  PB4 | LCD_SCK (hardware SPI)
-	
-// 1. Enable Port Clocks RCGCGPIO
-	SYSCTL_RCGCGPIO_R |= (SYSCTL_RCGCGPIO_R5|SYSCTL_RCGCGPIO_R1|SYSCTL_RCGCGPIO_R0);
-	delay(1);
-// unlock PF0 pin to remove default NMI function 
-	GPIO_PORTF_LOCK_R = GPIO_LOCK_KEY;
-	GPIO_PORTA_CR_R |= LCD_CS_B;
-	GPIO_PORTB_CR_R |= (LCD_MOSI_B|LCD_SCK_B);
-	GPIO_PORTF_CR_R |= (LCD_RS_B|LCD_RESET_B);
-// 2. Set data directions 1=output 0=input GPIODIR
-	GPIO_PORTA_DIR_R |= LCD_CS_B;
-	GPIO_PORTB_DIR_R |= (LCD_MOSI_B|LCD_SCK_B);
-	GPIO_PORTF_DIR_R |= (LCD_RS_B|LCD_RESET_B);
-// 3. Set Alternate function selections GPIOAFSEL
-	GPIO_PORTA_AFSEL_R &= ~(LCD_CS_B);
-	GPIO_PORTB_AFSEL_R |=  (LCD_MOSI_B|LCD_SCK_B);
-	GPIO_PORTB_PCTL_R  |= (GPIO_PCTL_PB4_SSI2CLK|GPIO_PCTL_PB7_SSI2TX);
-	GPIO_PORTF_AFSEL_R &= ~(LCD_RS_B|LCD_RESET_B);
-// 4. Set current drive strength GPIODRxR
-// 5. Set pull-up/pull-down/open-drain  GPIOPUR/PDR/ODR
-// 6. Enable digital/analog functions GPIODEN/GPIOAMSEL
-	GPIO_PORTA_DEN_R |= LCD_CS_B;
-	GPIO_PORTB_DEN_R |= (LCD_MOSI_B|LCD_SCK_B);
-	GPIO_PORTF_DEN_R |= (LCD_RS_B|LCD_RESET_B);
-// 7. Configure Interrupts GPIOIS, GPIOIBE, GPIOBE, GPIOEV, and GPIOIM
-
-  //Drive the ports to a reasonable starting state.
-  CLR_RESET;
-  CLR_RS;
-  SET_CS;
-  CLR_MOSI;
-  CLR_SCK;
-
-  // initialize SPI. By default the clock is 1.2MHz. The chip is good to 10 MHz
-  Initialize_SPI();
-
-	// Increase SSI clock to 8MHz maximum
-	// Not yet implemented but 1.2MHz gives ~40Hz? refresh in 84x48 window
-	// using 12-bit color pixel data
+	int i;
+	for (i = first*ST7735_MAX_X/2; i < (first+count)*ST7735_MAX_X/2; i++)
+	{
+		// Send two 12 bit/pixel colour pixels
+		SPI_sendData(i); // R1,G1
+		SPI_sendData(~i); // B1,R2
+		SPI_sendData(i/64); // G2,B2
+	}
 }
+#endif
 
+#if !NOKIA5110EMU_DMA || NOKIA5110EMU_FAST_BOOT == 1 || NOKIA5110EMU_SCROLL
 //============================================================================
-
-//********Nokia5110Emu_OutString*****************
-// Print a string of characters to the Nokia 5110 84x48 LCD.
-// The string will automatically wrap, so padding spaces may
-// be needed to make the output look optimal.
-// inputs: ptr  pointer to NULL-terminated ASCII string
-// outputs: none
-void Nokia5110Emu_OutString(unsigned char *ptr)
+//
+// Fill the current window with pixels of one colour in a single RAMWR burst,
+// keeping the SSI2 transmit FIFO topped up instead of waiting for each byte
+//
+static void LCD_fill_window(uint16_t colour)
 {
-  while(*ptr)
-	{
-    Nokia5110Emu_OutChar((unsigned char)*ptr);
-    ptr = ptr + 1;
+  uint16_t count = LCD_window_width*LCD_window_height;
+#if !NOKIA5110EMU_SSI_12BIT
+  const uint8_t pair[3] = PIXEL_PAIR(colour, colour);
+#endif
+  LCD_STAT(pixel_bytes, count*3/2);
+  LCD_TRACE(LCD_TRACE_DATA, 0, count*3/2);
+  // Select the LCD's data register and the LCD controller
+  LCD_TX_DATA();
+#if NOKIA5110EMU_SSI_12BIT
+  SPI_setFrame(SSI_CR0_DSS_12);
+  while (count--)
+    LCD_TX(colour);
+#else
+  for (; count; count -= 2)
+  {
+    LCD_TX(pair[0]); // Send Red1/Green1
+    LCD_TX(pair[1]); // Send Blue1/Red2
+    LCD_TX(pair[2]); // Send Green2/Blue2
   }
+#endif
+  // Wait for the data to be sent and De-Select the LCD controller
+  LCD_TX_END();
 }
+#endif
 
-//********Nokia5110Emu_Init*****************
-// Replace the Nokia5110 Initialisation with
-// a ST7735 initialisation and draw the external
-// frame surrounding the emulator window
-void Nokia5110Emu_Init(void)
+#if NOKIA5110EMU_FAST_BOOT == 1 || NOKIA5110EMU_SCROLL
+//============================================================================
+//
+// Fill the ST7735 to the left and right of the emulator window with
+// PIXEL_BORDER, leaving the emulator window itself alone
+//
+static void LCD_fill_sides(void)
 {
-	int i;
-	unsigned char label1[] = " Nokia 5110 ";
-	unsigned char label2[] =  " Emulator ";
-
-	// Initialize the Launchpad and SPI
-	Initialize_Launchpad();
-
-	//Initialize the ST7735 LCD controller
-  Initialize_LCD();
-	
-	// Initialise static data
-	LCD_cursor_x = 0;
-  LCD_cursor_y = 0;
-  LCD_window_x = 0;
-  LCD_window_y = 0;
-
-  // Fill full 128x128 ST7735 display with an RGB pattern
-	LCD_resize_window(ST7735_MAX_X, ST7735_MAX_Y);
-  for (i = 0; i < (ST7735_MAX_X * ST7735_MAX_Y / 2); i++)
-  {
-		// Send two 12 bit/pixel colour pixels
-    SPI_sendData(i); // R1,G1
-    SPI_sendData(~i); // B1,R2
-    SPI_sendData(i/64); // G2,B2
-  }
-	
-	// Display Emulator label
-	char_spacing=0;  // Gaps between text look bad outside emulator window
-	LCD_cursor_x = (ST7735_MAX_X-12*(CHAR_WIDTH+char_spacing))/2; // Centre 12 chars of label1
-	LCD_cursor_y = (ST7735_MAX_Y-NOKIA_MAX_Y)/2-3*CHAR_HEIGHT; // 3 rows above emulator window
-	Nokia5110Emu_OutString(label1);
-	LCD_cursor_x = (ST7735_MAX_X-10*(CHAR_WIDTH+char_spacing))/2; // Centre 10 chars of label2
-	LCD_cursor_y = (ST7735_MAX_Y-NOKIA_MAX_Y)/2-2*CHAR_HEIGHT; // 2 rows above emulator window
-	Nokia5110Emu_OutString(label2);
-	char_spacing=1; // Gaps between text maintain backward compatibilty inside emulator window
-
-	// Initialise the Nokia 5110 emulator window
-  Nokia5110Emu_Clear();
+  LCD_set_window(0, NOKIA_WINDOW_Y, LCD_SIDE_W, LCD_VIEW_H); // left
+  LCD_fill_window(PIXEL_BORDER);
+  LCD_set_window(ST7735_MAX_X-LCD_SIDE_W, NOKIA_WINDOW_Y,    // right
+                 LCD_SIDE_W, LCD_VIEW_H);
+  LCD_fill_window(PIXEL_BORDER);
 }
+#endif
 
-//********Nokia5110Emu_OutChar*****************
-// Print a character to the Nokia 5110 84x48 LCD.  The
-// character will be printed at the current cursor position,
-// the cursor will automatically be updated, and it will
-// wrap to the next row or back to the top if necessary.
-// One blank column of pixels will be printed on either side
-// of the character for readability.  Since characters are 8
-// pixels tall and 6 pixels wide, 14 characters fit per row,
-// and there are six rows.
-// inputs: data  character to print
-// outputs: none
-// Note this is slightly more compact than the original which only
-// allowed 12 chars per row
-void Nokia5110Emu_OutChar(unsigned char data)
+#if NOKIA5110EMU_FAST_BOOT == 1
+//============================================================================
+//
+// Fill the four sides of the ST7735 around the emulator window with
+// PIXEL_BORDER, leaving the emulator window itself alone
+//
+static void LCD_fill_border(void)
 {
-  // save the original draw window size
-	uint16_t height = LCD_window_height;
-	uint16_t width = LCD_window_width;
-
-	// Reduce the update window to the size of one ascii character
-  LCD_resize_window (CHAR_WIDTH, CHAR_HEIGHT);
-
-	// Write the character data
-	LCD_send_data( ASCII6[data-' '] );
-
-	// Restore the window to it's previous size
-	LCD_window_height = height;
-	LCD_window_width = width;
-
-	// Advance the text cursor to the next character position
-	LCD_cursor_x += CHAR_WIDTH+char_spacing;
-	if ( LCD_cursor_x + CHAR_WIDTH+char_spacing > LCD_window_width )
-	{
-		LCD_cursor_x = 0;
-		LCD_cursor_y += CHAR_HEIGHT;
-		if ( LCD_cursor_y + CHAR_HEIGHT > LCD_window_height )
-			LCD_cursor_y = 0;
-	}
+  LCD_set_window(0, 0, ST7735_MAX_X, NOKIA_WINDOW_Y); // above
+  LCD_fill_window(PIXEL_BORDER);
+  LCD_set_window(0, NOKIA_WINDOW_Y+LCD_VIEW_H,        // below
+                 ST7735_MAX_X, ST7735_MAX_Y-NOKIA_WINDOW_Y-LCD_VIEW_H);
+  LCD_fill_window(PIXEL_BORDER);
+  LCD_fill_sides();
 }
+#endif
 
-//********Nokia5110Emu_SetCursor*****************
-// Move the cursor to the desired X- and Y-position.  The
-// next character will be printed here.  X=0 is the leftmost
-// column.  Y=0 is the top row.
-// inputs: newX  new X-position of the cursor (0<=newX<=13)
-//         newY  new Y-position of the cursor (0<=newY<=5)
-// outputs: none
-void Nokia5110Emu_SetCursor(unsigned char newX, unsigned char newY)
+//============================================================================
+//
+// Write one entire window of data to the LCD
+// Two pixels of data are processed at a time as 12-bit colour data format combines
+// two 12-bit pixels into three data bytes for speed and efficiency, the three
+// bytes for each possible pair of pixels are looked up in LCD_pixel_pair
+//
+static void LCD_send_data(const char* buffer)
 {
-	if ( newX * CHAR_WIDTH + CHAR_WIDTH <= NOKIA_MAX_X )
-		LCD_cursor_x = newX*(CHAR_WIDTH+char_spacing);
-	if ( newY * CHAR_HEIGHT + CHAR_HEIGHT <= NOKIA_MAX_Y )
-		LCD_cursor_y = newY*CHAR_HEIGHT;
+  LCD_send_region(buffer, LCD_window_width);
 }
 
-//********Nokia5110Emu_Clear*****************
-// Clear the LCD by writing off pixels to the emulator window and 
-// reset the text cursor to (0,0) (top left corner of screen).
-// inputs: none
-// outputs: none
-void Nokia5110Emu_Clear(void)
+//============================================================================
+//
+// Write one entire window of data to the LCD from a region of a larger buffer
+// stride is the width in columns of the buffer the region is taken from, so a
+// window can be sent straight out of Screen without copying it first
+//
+static void LCD_send_region(const char* buffer, uint16_t stride)
 {
-  LCD_reset_window();
-  LCD_send_data( (void *)0 );
+  LCD_STAT(pixel_bytes, LCD_window_width*LCD_window_height*3/2);
+  LCD_TRACE(LCD_TRACE_DATA, 0, LCD_window_width*LCD_window_height*3/2);
+  // Select the LCD's data register and the LCD controller
+  LCD_TX_DATA();
+#if NOKIA5110EMU_SSI_12BIT
+	// One 12-bit frame per pixel, in the same order as the packed bytes
+	SPI_setFrame(SSI_CR0_DSS_12);
+#endif
+	// The shapes sent most often have kernels of their own
+	if ( LCD_KERNELS_ON() && LCD_window_width == CHAR_WIDTH && LCD_window_height == CHAR_HEIGHT &&
+	     stride == CHAR_WIDTH )
+		LCD_stream_glyph(buffer);
+	else if ( LCD_KERNELS_ON() && LCD_window_width == NOKIA_MAX_X && LCD_window_height == NOKIA_MAX_Y &&
+	          stride == NOKIA_MAX_X )
+		LCD_stream_frame(buffer);
+	else if ( LCD_KERNELS_ON() && LCD_window_width == NOKIA_MAX_X && LCD_window_height == 8 )
+		LCD_stream_strip(buffer);
+	else
+		LCD_stream_region(buffer, stride);
+  // Wait for the data to be sent and De-Select the LCD controller
+  LCD_TX_END();
 }
 
-//********Nokia5110Emu_DrawFullImage*****************
-// Fill the whole screen by drawing a 84x48 bitmap image.
-// inputs: ptr  pointer to 504 byte bitmap
-// outputs: none
-void Nokia5110Emu_DrawFullImage(const char *ptr)
+//============================================================================
+//
+// Stream a window of any size from a region of a buffer stride columns wide
+// to the LCD, which has already been selected for pixel data
+//
+static void LCD_stream_region(const char* buffer, uint16_t stride)
 {
-  LCD_reset_window();
-	LCD_send_data(ptr);
+  uint16_t row, col;
+#if NOKIA5110EMU_SSI_12BIT
+	// One 12-bit frame per pixel
+	for (row = 0; row < LCD_window_height; row++)
+	{
+		const uint8_t *bank = (const uint8_t *)&buffer[row/8*stride];
+		uint8_t shift = row%8;
+		for (col = 0; col < LCD_window_width; col++)
+			LCD_TX(LCD_PIXEL(bank, col, shift));
+	}
+#else
+	// Send exactly one window of data from buffer, one row of pixels at a time
+	for (row = 0; row < LCD_window_height; row++)
+	{
+		// Each row uses one bit of each byte in the 8-row bank it falls in
+		const uint8_t *bank = (const uint8_t *)&buffer[row/8*stride];
+		uint8_t shift = row%8;
+		for (col = 0; col < LCD_window_width; col += 2)
+		{
+			// Look up both pixels at once and keep the FIFO topped up
+			const uint8_t *pair = LCD_pixel_pair[LCD_PAIR_INDEX(bank, col, shift)];
+			LCD_TX(pair[0]); // Send Red1/Green1
+			LCD_TX(pair[1]); // Send Blue1/Red2
+			LCD_TX(pair[2]); // Send Green2/Blue2
+		}
+	}
+#endif
 }
 
-//********Nokia5110_Init*****************
-// Pass the command to EDUMKII ST7735 Nokia5110 Emulator
-void Nokia5110_Init(void)
-{
-	Nokia5110Emu_Init();
+//============================================================================
+//
+// Streaming kernels for the shapes sent most often: one character, the whole
+// emulator window and one whole bank. Each is LCD_stream_region with the
+// shape fixed at compile time, the eight rows of every bank written out so
+// each row's shift is a constant, and each row sent four columns at a time,
+// so a character row is unrolled completely. Only the pixel lookups and the
+// FIFO writes are left. Narrower spans and runs of text keep
+// LCD_stream_region
+//
+
+// Send columns COL and COL+1 of a bank at row SHIFT
+#if NOKIA5110EMU_SSI_12BIT
+#define LCD_KERNEL_PAIR(BANK, COL, SHIFT) do { \
+    LCD_TX(LCD_PIXEL(BANK, COL, SHIFT)); LCD_TX(LCD_PIXEL(BANK, (COL)+1, SHIFT)); } while(0)
+#else
+#define LCD_KERNEL_PAIR(BANK, COL, SHIFT) do { \
+    const uint8_t *pair = LCD_pixel_pair[LCD_PAIR_INDEX(BANK, COL, SHIFT)]; \
+    LCD_TX(pair[0]); LCD_TX(pair[1]); LCD_TX(pair[2]); } while(0)
+#endif
+// Send one row of an even WIDTH columns of a bank
+#define LCD_KERNEL_ROW(BANK, WIDTH, SHIFT) do { uint16_t col; \
+    for (col = 0; col + 4 <= (WIDTH); col += 4) \
+    { LCD_KERNEL_PAIR(BANK, col, SHIFT); LCD_KERNEL_PAIR(BANK, col + 2, SHIFT); } \
+    if ( (WIDTH) & 2 ) \
+      LCD_KERNEL_PAIR(BANK, col, SHIFT); } while(0)
+// Define kernel NAME sending BANKS banks of WIDTH columns each from a buffer
+// STRIDE columns wide
+#define LCD_KERNEL(NAME, WIDTH, BANKS, STRIDE) \
+static void NAME(const char* buffer) \
+{ \
+  uint16_t b; \
+  for (b = 0; b < (BANKS); b++) \
+  { \
+    const uint8_t *bank = (const uint8_t *)&buffer[b*(STRIDE)]; \
+    LCD_KERNEL_ROW(bank, WIDTH, 0); LCD_KERNEL_ROW(bank, WIDTH, 1); \
+    LCD_KERNEL_ROW(bank, WIDTH, 2); LCD_KERNEL_ROW(bank, WIDTH, 3); \
+    LCD_KERNEL_ROW(bank, WIDTH, 4); LCD_KERNEL_ROW(bank, WIDTH, 5); \
+    LCD_KERNEL_ROW(bank, WIDTH, 6); LCD_KERNEL_ROW(bank, WIDTH, 7); \
+  } \
 }
+#if (CHAR_WIDTH % 2) || (CHAR_HEIGHT % 8) || (NOKIA_MAX_X % 2) || (NOKIA_MAX_Y % 8)
+  #error The streaming kernels need an even width and whole banks
+#endif
+LCD_KERNEL(LCD_stream_glyph, CHAR_WIDTH, CHAR_HEIGHT/8, CHAR_WIDTH)
+LCD_KERNEL(LCD_stream_frame, NOKIA_MAX_X, NOKIA_MAX_Y/8, NOKIA_MAX_X)
+LCD_KERNEL(LCD_stream_strip, NOKIA_MAX_X, 1, SCREENW)
 
-//********Nokia5110_OutChar*****************
-// Wrapper to the new emulator function
-void Nokia5110_OutChar(unsigned char data)
+#if NOKIA5110EMU_GLYPH_ATLAS || (NOKIA5110EMU_NATIVE_FRAMES && !NOKIA5110EMU_DMA)
+//============================================================================
+//
+// Write count bytes of data already packed as 12-bit pixels to the LCD
+//
+static void LCD_send_packed(const uint8_t* data, uint16_t count)
 {
-  Nokia5110Emu_OutChar(data);
+  LCD_STAT(pixel_bytes, count);
+  LCD_TRACE(LCD_TRACE_DATA, 0, count);
+  SPI_setFrame(SSI_CR0_DSS_8);
+  // Select the LCD's data register and the LCD controller
+  LCD_TX_DATA();
+  while (count--)
+    LCD_TX(*data++);
+  // Wait for the data to be sent and De-Select the LCD controller
+  LCD_TX_END();
 }
+#endif
 
-//********Nokia5110_OutString*****************
-// Print a string of characters to the Nokia 5110 84x48 LCD.
-// The string will automatically wrap, so padding spaces may
-// be needed to make the output look optimal.
-// inputs: ptr  pointer to NULL-terminated ASCII string
-// outputs: none
-void Nokia5110_OutString(char *ptr)
+#if NOKIA5110EMU_UPSCALE
+#if !NOKIA5110EMU_DMA
+//============================================================================
+//
+// Write count columns of one bank of a buffer to the LCD window opened for
+// them by LCD_span_window, stretching each group of LCD_SCALE_IN columns
+// and each row as it goes with the LCD_scale_col and LCD_scale_row tables
+//
+static void LCD_send_scaled(const char* buffer, uint16_t count)
+{
+  const uint8_t *bank = (const uint8_t *)buffer;
+  uint16_t row, col, i;
+  LCD_STAT(pixel_bytes, LCD_window_width*LCD_window_height*3/2);
+  LCD_TRACE(LCD_TRACE_DATA, 0, LCD_window_width*LCD_window_height*3/2);
+  // Select the LCD's data register and the LCD controller
+  LCD_TX_DATA();
+#if NOKIA5110EMU_SSI_12BIT
+	SPI_setFrame(SSI_CR0_DSS_12);
+	for (row = 0; row < LCD_BANK_ROWS; row++)
 	{
-  while(*ptr)
+		uint8_t shift = LCD_scale_row[row];
+		for (col = 0; col < count; col += LCD_SCALE_IN)
+			for (i = 0; i < LCD_SCALE_OUT; i++)
+				LCD_TX(LCD_PIXEL(bank, col + LCD_scale_col[i], shift));
+	}
+#else
+	for (row = 0; row < LCD_BANK_ROWS; row++)
 	{
-    Nokia5110_OutChar(*ptr);
-    ptr = ptr + 1;
-  }
+		uint8_t shift = LCD_scale_row[row];
+		for (col = 0; col < count; col += LCD_SCALE_IN)
+			for (i = 0; i < LCD_SCALE_OUT; i += 2)
+			{
+				const uint8_t *pair = LCD_pixel_pair[((bank[col + LCD_scale_col[i]]>>shift)&1) |
+				                                     (((bank[col + LCD_scale_col[i+1]]>>shift)&1)<<1)];
+				LCD_TX(pair[0]); // Send Red1/Green1
+				LCD_TX(pair[1]); // Send Blue1/Red2
+				LCD_TX(pair[2]); // Send Green2/Blue2
+			}
+	}
+#endif
+  // Wait for the data to be sent and De-Select the LCD controller
+  LCD_TX_END();
+}
+#endif
+
+//============================================================================
+//
+// Send the xsize columns of the shadow copy just written at the text cursor
+// to the scaled emulator window, text columns do not fall on whole groups of
+// LCD_SCALE_IN so the span is widened to them
+//
+static void LCD_send_text(uint16_t xsize)
+{
+  uint16_t last = LCD_ctx->cursor_x + xsize - 1;
+  if ( LCD_ctx->cursor_x >= SCREENW )
+    return;
+  if ( last >= SCREENW )
+    last = SCREENW - 1;
+#if NOKIA5110EMU_DMA
+  LCD_dma_count = 0;
+#endif
+  LCD_send_span(LCD_text_row()/8, LCD_ctx->cursor_x & ~(LCD_SCALE_IN-1), last | (LCD_SCALE_IN-1));
+#if NOKIA5110EMU_DMA
+  LCD_dma_kick();
+#endif
+}
+#endif
+
+//============================================================================
+//
+// Send only the parts of a new 84x48 frame which differ from the last one sent
+// Each 8-row bank is compared with the shadow copy and the span of columns from
+// the first to the last changed byte is sent in its own tightly sized window
+//
+static void LCD_update_window(const char* buffer)
+{
+  uint16_t bank, first, last, i;
+  if ( LCD_deferred() )
+  {
+    // the whole shadow copy is sent once the LCD is ready
+    for (i = 0; i < SCREENW*SCREENH/8; i++)
+      LCD_ctx->shadow[i] = buffer[i];
+    LCD_MIRROR_CHANGED();
+    return;
+  }
+  LCD_STAT(frames, 1);
+
+#if NOKIA5110EMU_DMA
+  // the shadow copy is the source of the transfer so it must not be changed
+  LCD_dma_wait();
+  LCD_dma_count = 0;
+#endif
+  for (bank = 0; bank < SCREENH/8; bank++)
+  {
+    const char *new_bank = &buffer[bank*SCREENW];
+    char *old_bank = &LCD_ctx->shadow[LCD_STORED_BANK(bank)*SCREENW];
+    if ( !LCD_find_span(new_bank, old_bank, &first, &last) )
+      continue; // nothing changed
+    // window width must be even so align the span to pixel pairs, or to
+    // whole groups of columns when they are scaled
+    first &= ~(LCD_SCALE_IN-1);
+    last |= LCD_SCALE_IN-1;
+    for (i = first; i <= last; i++)
+      old_bank[i] = new_bank[i];
+    LCD_send_span(LCD_STORED_BANK(bank), first, last);
+  }
+#if NOKIA5110EMU_DMA
+  LCD_dma_kick();
+#endif
+  LCD_MIRROR_CHANGED();
+}
+
+//============================================================================
+//
+// Find the first and last columns of a bank which differ from the shadow copy
+// Whole words are compared from each end while the new bank is word aligned,
+// leaving only the bytes of the first and last changed words to be checked.
+// Returns 0 if nothing changed
+//
+static int LCD_find_span(const char* new_bank, const char* old_bank, uint16_t* first, uint16_t* last)
+{
+  uint16_t f = 0, l = SCREENW;
+  if ( (SCREENW % 4) == 0 && ((uintptr_t)new_bank & 3) == 0 )
+  {
+    const uint32_t *n = (const uint32_t *)new_bank;
+    const uint32_t *o = (const uint32_t *)old_bank;
+    while ( f < SCREENW && n[f/4] == o[f/4] )
+      f += 4;
+    if ( f == SCREENW )
+      return 0;
+    while ( n[l/4-1] == o[l/4-1] )
+      l -= 4;
+  }
+  for (; f < SCREENW && new_bank[f] == old_bank[f]; f++) {};
+  if (f == SCREENW)
+    return 0;
+  for (l--; new_bank[l] == old_bank[l]; l--) {};
+  *first = f;
+  *last = l;
+  return 1;
+}
+
+//============================================================================
+//
+// Send columns first to last of one bank of the shadow copy to the LCD bank
+// holding it, with uDMA the span is only added to the list of regions to be sent
+// A span which is all on or all off pixels, such as a cleared or filled
+// rectangle, is sent as a fill so it is never expanded
+//
+static void LCD_send_span(uint16_t bank, uint16_t first, uint16_t last)
+{
+  const char *data = &LCD_ctx->shadow[bank*SCREENW + first];
+  uint16_t i, count = last - first + 1;
+#if !NOKIA5110EMU_DMA
+  // save the original draw window size
+  uint16_t height = LCD_window_height;
+  uint16_t width = LCD_window_width;
+#endif
+
+  for (i = 1; i < count && data[i] == data[0]; i++) {};
+  if ( i == count && (data[0] == 0 || data[0] == (char)0xFF) )
+  {
+    LCD_fill_span(bank, first, last, data[0]);
+    return;
+  }
+#if NOKIA5110EMU_DMA
+  LCD_dma_add(bank, first, last, 0, 0);
+#else
+  LCD_span_window(LCD_ctx, bank, first, last, LCD_BANK_ROWS);
+#if NOKIA5110EMU_UPSCALE
+  LCD_send_scaled(data, count);
+#else
+  LCD_send_region(data, SCREENW);
+#endif
+
+  // Restore the window to it's previous size
+  LCD_window_height = height;
+  LCD_window_width = width;
+#endif
+}
+
+//============================================================================
+//
+// Fill columns first to last of one LCD bank with all on (bits 0xFF) or all
+// off (bits 0) pixels. uDMA sends the whole span from a single byte when both
+// pixels of a pair pack to three equal bytes, as black and white do
+//
+static void LCD_fill_span(uint16_t bank, uint16_t first, uint16_t last, uint8_t bits)
+{
+#if NOKIA5110EMU_DMA
+  const uint8_t *pair = LCD_pixel_pair[bits & 3];
+  // anything else is expanded from the shadow copy as usual
+  LCD_dma_add(bank, first, last, pair[0] == pair[1] && pair[1] == pair[2], pair[0]);
+#else
+  // save the original draw window size
+  uint16_t height = LCD_window_height;
+  uint16_t width = LCD_window_width;
+
+  LCD_span_window(LCD_ctx, bank, first, last, LCD_BANK_ROWS);
+  LCD_fill_window(bits ? PIXEL_ON : PIXEL_OFF);
+
+  // Restore the window to it's previous size
+  LCD_window_height = height;
+  LCD_window_width = width;
+#endif
+}
+
+//============================================================================
+//
+// Record xsize columns of one bank of data written at the text cursor in the
+// shadow copy, ignoring anything outside the emulator window
+//
+static void LCD_update_shadow(const char* data, uint16_t xsize)
+{
+  uint16_t i;
+  if ( LCD_ctx->shadow_valid )
+  {
+#if NOKIA5110EMU_UPSCALE && NOKIA5110EMU_DMA
+    // the shadow copy is the source of any transfer still in progress
+    LCD_dma_wait();
+#endif
+    for (i = 0; i < xsize && LCD_ctx->cursor_x + i < SCREENW; i++)
+      LCD_ctx->shadow[LCD_text_row()/8*SCREENW + LCD_ctx->cursor_x + i] = data[i];
+    LCD_MIRROR_CHANGED();
+#if NOKIA5110EMU_UPSCALE
+    // text is only drawn in the scaled window from the shadow copy
+    if ( !LCD_deferred() )
+      LCD_send_text(xsize);
+#endif
+  }
+}
+
+//============================================================================
+//
+// Open the LCD window showing columns first to last of a display from the top
+// of one bank down for rows rows, first and last + 1 must fall on groups of
+// LCD_SCALE_IN
+//
+static void LCD_span_window(const struct LCD_context* ctx, uint16_t bank, uint16_t first, uint16_t last, uint16_t rows)
+{
+  LCD_set_window(ctx->x + LCD_SCALE_X(first), ctx->y + bank*LCD_BANK_ROWS,
+                 LCD_SCALE_X(last + 1) - LCD_SCALE_X(first), rows);
+}
+
+#if NOKIA5110EMU_DMA
+#if !NOKIA5110EMU_UPSCALE
+//============================================================================
+//
+// Expand a window of 1-bit pixel data taken from a region of a larger buffer
+// into 12-bit pixel data in dest, ready to be sent to the LCD by uDMA
+//
+static void LCD_expand_region(uint8_t* dest, const char* buffer, uint16_t stride, uint16_t xsize, uint16_t ysize)
+{
+  uint16_t row, col;
+	for (row = 0; row < ysize; row++)
+	{
+		const uint8_t *bank = (const uint8_t *)&buffer[row/8*stride];
+		uint8_t shift = row%8;
+		for (col = 0; col < xsize; col += 2)
+		{
+			const uint8_t *pair = LCD_pixel_pair[LCD_PAIR_INDEX(bank, col, shift)];
+			*dest++ = pair[0]; // Red1/Green1
+			*dest++ = pair[1]; // Blue1/Red2
+			*dest++ = pair[2]; // Green2/Blue2
+		}
+	}
+}
+#endif
+
+#if NOKIA5110EMU_UPSCALE
+//============================================================================
+//
+// Expand count columns of one bank of a buffer into 12-bit pixel data in dest
+// stretched the same way as LCD_send_scaled, ready to be sent by uDMA
+//
+static void LCD_expand_scaled(uint8_t* dest, const char* buffer, uint16_t count)
+{
+  const uint8_t *bank = (const uint8_t *)buffer;
+  uint16_t row, col, i;
+	for (row = 0; row < LCD_BANK_ROWS; row++)
+	{
+		uint8_t shift = LCD_scale_row[row];
+		for (col = 0; col < count; col += LCD_SCALE_IN)
+			for (i = 0; i < LCD_SCALE_OUT; i += 2)
+			{
+				const uint8_t *pair = LCD_pixel_pair[((bank[col + LCD_scale_col[i]]>>shift)&1) |
+				                                     (((bank[col + LCD_scale_col[i+1]]>>shift)&1)<<1)];
+				*dest++ = pair[0]; // Red1/Green1
+				*dest++ = pair[1]; // Blue1/Red2
+				*dest++ = pair[2]; // Green2/Blue2
+			}
+	}
+}
+#endif
+
+//============================================================================
+//
+// Add columns first to last of one bank to the regions uDMA sends in this
+// update, split into regions no wider than LCD_DMA_SPAN columns
+//
+static void LCD_dma_add(uint16_t bank, uint16_t first, uint16_t last, uint8_t solid, uint8_t pattern)
+{
+  do
+  {
+    struct LCD_region *r = &LCD_dma_region[LCD_dma_count++];
+    r->bank = bank;
+    r->first = first;
+    r->last = last - first < LCD_DMA_SPAN ? last : first + LCD_DMA_SPAN - 1;
+    r->solid = solid;
+    r->pattern = pattern;
+    r->display = LCD_ctx - LCD_context;
+    r->rows = LCD_BANK_ROWS;
+#if NOKIA5110EMU_NATIVE_FRAMES
+    r->packed = 0;
+#endif
+    first = r->last + 1;
+  } while ( first <= last );
+}
+
+//============================================================================
+//
+// Expand one region of the shadow copy into its transfer buffer
+//
+static void LCD_dma_expand(uint8_t region)
+{
+  struct LCD_region *r = &LCD_dma_region[region];
+  const char *shadow = LCD_context[r->display].shadow;
+  if ( r->solid )
+    return; // sent straight from r->pattern
+#if NOKIA5110EMU_NATIVE_FRAMES
+  if ( r->packed )
+    return; // sent straight from r->packed
+#endif
+#if NOKIA5110EMU_UPSCALE
+  LCD_expand_scaled(LCD_dma_buffer[region&1], &shadow[r->bank*SCREENW + r->first],
+                    r->last - r->first + 1);
+#else
+  LCD_expand_region(LCD_dma_buffer[region&1], &shadow[r->bank*SCREENW + r->first],
+                    SCREENW, r->last - r->first + 1, 8);
+#endif
+}
+
+//============================================================================
+//
+// Open the LCD window for one region and start uDMA sending its pixel data
+//
+static void LCD_dma_start(uint8_t region)
+{
+  struct LCD_region *r = &LCD_dma_region[region];
+  uint16_t count = (LCD_SCALE_X(r->last + 1) - LCD_SCALE_X(r->first))*LCD_BANK_ROWS*3/2; // bytes of pixel data
+  uint32_t *control = &LCD_dma_table[LCD_DMA_CHANNEL*4];
+  // save the original draw window size
+  uint16_t height = LCD_window_height;
+  uint16_t width = LCD_window_width;
+
+  if ( r->rows )
+    LCD_span_window(&LCD_context[r->display], r->bank, r->first, r->last, r->rows);
+
+  // Restore the window to it's previous size
+  LCD_window_height = height;
+  LCD_window_width = width;
+
+  // Select the LCD's data register
+  SET_RS;
+  // Select the LCD controller
+  CLR_CS;
+  LCD_STAT(pixel_bytes, count);
+  LCD_TRACE(LCD_TRACE_DATA, 0, count);
+  // Byte transfers from the buffer, or the same pattern byte for a solid
+  // region, to the fixed SSI2 data register
+  control[0] = r->solid ? (uint32_t)&r->pattern             // fixed source
+                        : (uint32_t)&LCD_dma_buffer[region&1][count-1]; // source end pointer
+#if NOKIA5110EMU_NATIVE_FRAMES
+  if ( r->packed )
+    control[0] = (uint32_t)&r->packed[count-1];
+#endif
+  control[1] = (uint32_t)&SSI2_DR_R;                        // destination end pointer
+  control[2] = UDMA_CHCTL_DSTINC_NONE | UDMA_CHCTL_DSTSIZE_8 |
+               (r->solid ? UDMA_CHCTL_SRCINC_NONE : UDMA_CHCTL_SRCINC_8) | UDMA_CHCTL_SRCSIZE_8 |
+               UDMA_CHCTL_ARBSIZE_4 |                       // SSI requests at half empty FIFO
+               ((count-1)<<UDMA_CHCTL_XFERSIZE_S) |
+               UDMA_CHCTL_XFERMODE_BASIC;
+  UDMA_ENASET_R = BIT(LCD_DMA_CHANNEL);
+  SSI2_DMACTL_R |= SSI_DMACTL_TXDMAE;
+}
+
+//============================================================================
+//
+// Start sending the first region of an update, the rest are sent by SSI2_Handler
+//
+static void LCD_dma_kick(void)
+{
+  if ( LCD_dma_count )
+  {
+    LCD_dma_busy = 1;
+    LCD_dma_next = 0;
+    LCD_dma_expand(0);
+    if ( LCD_dma_count > 1 )
+      LCD_dma_expand(1);
+    LCD_dma_start(0);
+  }
+}
+
+//============================================================================
+//
+// Wait until all regions of the last update have been sent
+//
+static void LCD_dma_wait(void)
+{
+  while (LCD_dma_busy) {};
+}
+
+//============================================================================
+//
+// uDMA transfer complete interrupt for SSI2
+// Starts the next region (already expanded) and then expands the one after
+// into the buffer which has just been emptied
+//
+void SSI2_Handler(void)
+{
+  uint8_t next = LCD_dma_next + 1;
+  // acknowledge the completion and stop further SSI transmit requests
+  UDMA_CHIS_R = BIT(LCD_DMA_CHANNEL);
+  SSI2_DMACTL_R &= ~SSI_DMACTL_TXDMAE;
+  // wait until the last bytes have left the FIFO
+  SSI2_WAIT_IDLE();
+  // De-Select the LCD controller
+  CLR_CS;
+  LCD_dma_next = next;
+  if ( next < LCD_dma_count )
+  {
+    LCD_dma_start(next);
+    if ( next + 1 < LCD_dma_count )
+      LCD_dma_expand(next + 1);
+  }
+  else
+  {
+    LCD_dma_busy = 0;
+    if ( LCD_dma_callback )
+      LCD_dma_callback();
+#if NOKIA5110EMU_DOUBLE_BUFFER
+    // start the frame which was flipped while this one was being sent
+    if ( LCD_front_pending )
+    {
+      LCD_DEFAULT_BEGIN();
+      LCD_front_pending = 0;
+      LCD_update_window(LCD_front);
+      LCD_DEFAULT_END();
+    }
+#endif
+  }
+}
+
+//============================================================================
+//
+//  Initialise uDMA channel 13 for SSI2 transmit
+//
+void Initialize_UDMA(void)
+{
+	volatile unsigned long temp;
+	SYSCTL_RCGCDMA_R |= SYSCTL_RCGCDMA_R0; // Enable uDMA Clock
+	temp = SYSCTL_RCGCDMA_R;
+	UDMA_CFG_R = UDMA_CFG_MASTEN;           // enable uDMA controller
+	UDMA_CTLBASE_R = (uint32_t)LCD_dma_table;
+	                                        // channel 13 encoding 2 = SSI2 TX
+	UDMA_CHMAP1_R = (UDMA_CHMAP1_R&~UDMA_CHMAP1_CH13SEL_M)|0x00200000;
+	UDMA_PRIOCLR_R = BIT(LCD_DMA_CHANNEL);     // default priority
+	UDMA_ALTCLR_R = BIT(LCD_DMA_CHANNEL);      // use primary control structure
+	UDMA_USEBURSTCLR_R = BIT(LCD_DMA_CHANNEL); // respond to single and burst requests
+	UDMA_REQMASKCLR_R = BIT(LCD_DMA_CHANNEL);  // allow SSI2 requests
+	                                        // priority 6 for transfer complete interrupt
+	NVIC_PRI14_R = (NVIC_PRI14_R&0xFFFF00FF)|0x0000C000;
+	NVIC_EN1_R = LCD_DMA_INT_B;             // enable SSI2 interrupt in NVIC
+}
+#endif
+
+//============================================================================
+//
+//  Initialise the SPI specific settings of the launchpad
+//
+void Initialize_SPI(void)
+{
+#if NOKIA5110EMU_HOST
+  // there is no SSI2, only the bit rate is needed to time the frames
+  SPI_setClock(NOKIA5110EMU_SPI_INIT_HZ);
+#else
+	volatile unsigned long temp;
+	// Enable the SSI2 module using the RCGCSSI register (see page 345 of TM4C datasheet).
+	SYSCTL_RCGCSSI_R |= SYSCTL_RCGCSSI_R2; // Enable SSI2 Clock
+	temp = SYSCTL_RCGCSSI_R;
+  // Configure SSI2
+  SSI2_CR1_R &= ~SSI_CR1_SSE;           // disable SSI2
+  SSI2_CR1_R &= ~SSI_CR1_MS;            // master mode
+                                        // configure for system clock/PLL baud clock source
+  SSI2_CC_R = (SSI2_CC_R&~SSI_CC_CS_M)+SSI_CC_CS_SYSPLL;
+  SSI2_CR0_R &= ~(SSI_CR0_SPH |         // SPH = 0
+                  SSI_CR0_SPO);         // SPO = 0
+                                        // clock dividers for the initialisation rate
+                                        // SysClk/(CPSDVSR*(1+SCR))
+                                        // 80/(2*(1+4)) = 8 MHz by default
+  SPI_setClock(NOKIA5110EMU_SPI_INIT_HZ);
+                                        // FRF = Freescale format
+  SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_FRF_M)+SSI_CR0_FRF_MOTO;
+                                        // DSS = 8-bit data
+  SSI2_CR0_R = (SSI2_CR0_R&~SSI_CR0_DSS_M)+SSI_CR0_DSS_8;
+  SSI2_CR1_R |= SSI_CR1_SSE;            // enable SSI2
+#if NOKIA5110EMU_TX_QUEUE
+  SSI2_IM_R = 0;                        // SSI2_Handler enables TXIM when needed
+                                        // priority 6 for the transmit interrupt
+  NVIC_PRI14_R = (NVIC_PRI14_R&0xFFFF00FF)|0x0000C000;
+  NVIC_EN1_R = LCD_TXQ_INT_B;           // enable SSI2 interrupt in NVIC
+#endif
+#endif
+}
+
+//============================================================================
+//
+//  Initialise the GPIOs on the launchpad used to control the LCD
+//
+void Initialize_Launchpad()
+{
+// LCD SPI & control lines
+//      TM4C123G
+//   #31   |  PF4 | LCD_RS
+//   #17   |  PF0 | LCD_RESET
+//   #13   |  PA4 | LCD_CS_NOT (or SPI SS)
+//   #15   |  PB7 | LCD_MOSI (hardware SPI)
+//   #14   |  PB6 | not used (would be MISO)
+//   #7    |  PB4 | LCD_SCK (hardware SPI)
+	
+#if !NOKIA5110EMU_HOST
+// 1. Enable Port Clocks RCGCGPIO
+	SYSCTL_RCGCGPIO_R |= (SYSCTL_RCGCGPIO_R5|SYSCTL_RCGCGPIO_R1|SYSCTL_RCGCGPIO_R0);
+	delay(1);
+// unlock PF0 pin to remove default NMI function 
+	GPIO_PORTF_LOCK_R = GPIO_LOCK_KEY;
+	GPIO_PORTA_CR_R |= LCD_CS_B;
+	GPIO_PORTB_CR_R |= (LCD_MOSI_B|LCD_SCK_B);
+	GPIO_PORTF_CR_R |= (LCD_RS_B|LCD_RESET_B);
+// 2. Set data directions 1=output 0=input GPIODIR
+	GPIO_PORTA_DIR_R |= LCD_CS_B;
+	GPIO_PORTB_DIR_R |= (LCD_MOSI_B|LCD_SCK_B);
+	GPIO_PORTF_DIR_R |= (LCD_RS_B|LCD_RESET_B);
+// 3. Set Alternate function selections GPIOAFSEL
+	GPIO_PORTA_AFSEL_R &= ~(LCD_CS_B);
+	GPIO_PORTB_AFSEL_R |=  (LCD_MOSI_B|LCD_SCK_B);
+	GPIO_PORTB_PCTL_R  |= (GPIO_PCTL_PB4_SSI2CLK|GPIO_PCTL_PB7_SSI2TX);
+	GPIO_PORTF_AFSEL_R &= ~(LCD_RS_B|LCD_RESET_B);
+// 4. Set current drive strength GPIODRxR
+// 5. Set pull-up/pull-down/open-drain  GPIOPUR/PDR/ODR
+// 6. Enable digital/analog functions GPIODEN/GPIOAMSEL
+	GPIO_PORTA_DEN_R |= LCD_CS_B;
+	GPIO_PORTB_DEN_R |= (LCD_MOSI_B|LCD_SCK_B);
+	GPIO_PORTF_DEN_R |= (LCD_RS_B|LCD_RESET_B);
+// 7. Configure Interrupts GPIOIS, GPIOIBE, GPIOBE, GPIOEV, and GPIOIM
+#endif
+
+  //Drive the ports to a reasonable starting state.
+  CLR_RESET;
+  CLR_RS;
+  SET_CS;
+  CLR_MOSI;
+  CLR_SCK;
+
+  // initialize SPI at NOKIA5110EMU_SPI_INIT_HZ. The ST7735S is good to 15 MHz
+  Initialize_SPI();
+
+	// The SSI clock is increased to NOKIA5110EMU_SPI_HZ for pixel streaming
+	// once the ST7735 has been initialised, see Nokia5110Emu_Init
+}
+
+//============================================================================
+
+//********Nokia5110Emu_OutString*****************
+// Print a string of characters to the Nokia 5110 84x48 LCD.
+// The string will automatically wrap, so padding spaces may
+// be needed to make the output look optimal.
+// inputs: ptr  pointer to NULL-terminated ASCII string
+// outputs: none
+void Nokia5110Emu_OutString(unsigned char *ptr)
+{
+  LCD_TIMER_LOCK();
+  while(*ptr)
+    ptr = ptr + LCD_out_run(ptr);
+  LCD_TIMER_UNLOCK();
+}
+
+//============================================================================
+//
+// Print as many characters from a string as fit on the current text row
+// using one window and one RAMWR burst, including the blank columns between
+// characters. Returns the number of characters printed
+//
+static int LCD_out_run(const unsigned char* ptr)
+{
+	char run[ST7735_MAX_X];
+	uint16_t pitch = CHAR_WIDTH+LCD_ctx->spacing;
+	uint16_t xsize = 0;
+	int count = 0;
+  // save the original draw window size
+	uint16_t height = LCD_window_height;
+	uint16_t width = LCD_window_width;
+
+	// The first character is always printed, more are added while they fit
+	do
+	{
+		uint16_t i;
+		for (i = 0; i < CHAR_WIDTH; i++)
+			run[xsize++] = ASCII6[ptr[count]-' '][i];
+		for (i = 0; i < LCD_ctx->spacing; i++)
+			run[xsize++] = 0;
+		count++;
+	} while ( ptr[count] && LCD_ctx->cursor_x + xsize + pitch <= width && xsize + pitch <= ST7735_MAX_X );
+	// window width must be even, an odd width always ends with a blank column
+	xsize &= ~1;
+
+	// Write the whole run of characters in one window
+	if ( !LCD_deferred() && LCD_DIRECT_TEXT() )
+	{
+		LCD_resize_window (xsize, CHAR_HEIGHT);
+#if NOKIA5110EMU_GLYPH_ATLAS
+		// whole pixel pairs per character can be copied from the atlas
+		if ( (pitch&1) == 0 )
+			LCD_send_glyphs( ptr, count );
+		else
+#endif
+		LCD_send_data( run );
+	}
+	LCD_update_shadow( run, xsize );
+
+	// Restore the window to it's previous size
+	LCD_window_height = height;
+	LCD_window_width = width;
+
+	LCD_advance_cursor(count*pitch);
+	return count;
+}
+
+#if NOKIA5110EMU_GLYPH_ATLAS
+//============================================================================
+//
+// Write a run of characters with an even number of spacing columns to the LCD
+// by copying each row of every character straight from the glyph atlas
+//
+static void LCD_send_glyphs(const unsigned char* ptr, int count)
+{
+  uint16_t row, i;
+  int c;
+  LCD_STAT(pixel_bytes, LCD_window_width*LCD_window_height*3/2);
+  LCD_TRACE(LCD_TRACE_DATA, 0, LCD_window_width*LCD_window_height*3/2);
+  SPI_setFrame(SSI_CR0_DSS_8);
+  // Select the LCD's data register and the LCD controller
+  LCD_TX_DATA();
+  for (row = 0; row < CHAR_HEIGHT; row++)
+    for (c = 0; c < count; c++)
+    {
+      const uint8_t *glyph = &ASCII6_atlas[ptr[c]-' '][row*GLYPH_ROW_BYTES];
+      for (i = 0; i < GLYPH_ROW_BYTES; i++)
+        LCD_TX(glyph[i]);
+      for (i = 0; i < LCD_ctx->spacing/2; i++)
+      {
+        LCD_TX(LCD_pixel_pair[0][0]);
+        LCD_TX(LCD_pixel_pair[0][1]);
+        LCD_TX(LCD_pixel_pair[0][2]);
+      }
+    }
+  // Wait for the data to be sent and De-Select the LCD controller
+  LCD_TX_END();
+}
+#endif
+
+//============================================================================
+//
+// Move the text cursor on by xsize columns, wrapping to the next row or back
+// to the top if there is no room for another character
+// With NOKIA5110EMU_SCROLL the emulator window scrolls up instead of wrapping
+// back to the top
+//
+static void LCD_advance_cursor(uint16_t xsize)
+{
+	LCD_ctx->cursor_x += xsize;
+	if ( LCD_ctx->cursor_x + CHAR_WIDTH+LCD_ctx->spacing > LCD_window_width )
+	{
+		LCD_ctx->cursor_x = 0;
+		LCD_ctx->cursor_y += CHAR_HEIGHT;
+		if ( LCD_ctx->cursor_y + CHAR_HEIGHT > LCD_window_height )
+		{
+#if NOKIA5110EMU_SCROLL
+			if ( LCD_window_y == NOKIA_WINDOW_Y && !LCD_deferred() )
+			{
+				LCD_scroll_line();
+				LCD_ctx->cursor_y -= CHAR_HEIGHT;
+			}
+			else
+#endif
+			LCD_ctx->cursor_y = 0;
+		}
+	}
+}
+
+//============================================================================
+//
+// Row of LCD memory and the shadow copy the text cursor row is stored in,
+// which is only moved by scrolling inside the emulator window
+//
+static uint16_t LCD_text_row(void)
+{
+#if NOKIA5110EMU_SCROLL
+	if ( LCD_window_y == NOKIA_WINDOW_Y )
+		return (LCD_ctx->cursor_y + LCD_scroll_y) % NOKIA_MAX_Y;
+#endif
+	return LCD_ctx->cursor_y;
+}
+
+#if NOKIA5110EMU_SCROLL
+//============================================================================
+//
+// Scroll the emulator window up one text row, the top row is cleared and
+// then scrolled round to become the new bottom row
+//
+static void LCD_scroll_line(void)
+{
+  uint16_t i;
+  // save the original draw window size
+  uint16_t height = LCD_window_height;
+  uint16_t width = LCD_window_width;
+#if NOKIA5110EMU_DMA
+  // the shadow copy is the source of any transfer still in progress
+  LCD_dma_wait();
+#endif
+  LCD_set_window(NOKIA_WINDOW_X, NOKIA_WINDOW_Y + LCD_scroll_y, NOKIA_MAX_X, CHAR_HEIGHT);
+  LCD_fill_window(PIXEL_OFF);
+  for (i = 0; i < SCREENW; i++)
+    LCD_ctx->shadow[LCD_scroll_y/8*SCREENW + i] = 0;
+  LCD_scroll_to( (LCD_scroll_y + CHAR_HEIGHT) % NOKIA_MAX_Y );
+
+  // Restore the window to it's previous size
+  LCD_window_height = height;
+  LCD_window_width = width;
+}
+
+//============================================================================
+//
+// Show LCD memory row offset of the emulator window at the top of the window
+// With MY=1 the rows of the scroll area are in memory bottom to top, so the
+// start address counts back from the end of the area as offset goes up
+//
+static void LCD_scroll_to(uint16_t offset)
+{
+  uint16_t start = LCD_SCROLL_TFA + (NOKIA_MAX_Y - offset) % NOKIA_MAX_Y;
+#if NOKIA5110EMU_DMA
+  // the SSI must not be used while pixel data is still being streamed
+  LCD_dma_wait();
+#endif
+  LCD_scroll_y = offset;
+  LCD_MIRROR_CHANGED();
+  //VSCSAD (37h): Scroll Start Address of RAM
+  SPI_sendCommand(ST7735_VSCSAD);
+  SPI_sendData(start >> 8);   //SSA[15:8]
+  SPI_sendData(start & 0xFF); //SSA[ 7:0]
+}
+#endif
+
+//============================================================================
+//
+// Check whether drawing must only update the shadow copy because the LCD is
+// still being initialised. The first call after the bring-up has finished
+// draws the labels and the emulator window
+//
+static int LCD_deferred(void)
+{
+#if NOKIA5110EMU_ASYNC_INIT
+  if ( LCD_boot_state == LCD_BOOT_SHOW )
+  {
+    LCD_boot_state = LCD_BOOT_READY;
+    LCD_show_window();
+#if NOKIA5110EMU_FRAME_PACING
+    if ( LCD_pace_hz )
+      LCD_pace_start();
+#endif
+#if NOKIA5110EMU_POWER_SAVE
+    LCD_power_apply();
+#endif
+  }
+  return LCD_boot_state != LCD_BOOT_READY;
+#else
+  return 0;
+#endif
+}
+
+#if NOKIA5110EMU_ASYNC_INIT
+//============================================================================
+//
+// Draw the labels and everything drawn into the shadow copy of each display
+// while the LCD was being initialised, leaving the text cursors where they were
+//
+static void LCD_show_window(void)
+{
+  struct LCD_context *ctx = LCD_ctx;
+  int d;
+#if NOKIA5110EMU_FAST_BOOT < 2
+  LCD_draw_labels();
+#endif
+  for (d = 0; d < NOKIA5110EMU_DISPLAYS; d++)
+    if ( LCD_context[d].buffer )
+    {
+      uint8_t cursor_x, cursor_y;
+      LCD_ctx = &LCD_context[d];
+      cursor_x = LCD_ctx->cursor_x;
+      cursor_y = LCD_ctx->cursor_y;
+      Nokia5110Emu_DrawFullImage(LCD_ctx->shadow);
+      LCD_ctx->cursor_x = cursor_x;
+      LCD_ctx->cursor_y = cursor_y;
+    }
+  // DrawFullImage moved the text window to the last display drawn
+  LCD_ctx = ctx;
+  LCD_window_x = ctx->x;
+  LCD_window_y = ctx->y;
+}
+
+//============================================================================
+//
+// Start Timer5A counting down msec milliseconds to the next bring-up state
+//
+static void LCD_boot_wait(uint32_t msec)
+{
+  TIMER5_TAILR_R = msec*(SYSTEM_CLOCK_HZ/1000) - 1;
+  TIMER5_CTL_R |= TIMER_CTL_TAEN;
+}
+
+//============================================================================
+//
+// Run the next step of the LCD bring-up from the Timer5A one-shot timeout
+// The steps and delays are the same as Initialize_LCD and Nokia5110Emu_Init
+//
+static void LCD_boot_step(void)
+{
+  // save the draw window size which the application may be using
+  uint16_t height = LCD_window_height;
+  uint16_t width = LCD_window_width;
+
+  switch ( LCD_boot_state )
+  {
+    case LCD_BOOT_WAKE:
+      SET_RESET;
+      LCD_boot_state = LCD_BOOT_SLEEP_OUT;
+      LCD_boot_wait(150);
+      break;
+    case LCD_BOOT_SLEEP_OUT:
+      SPI_sendCommand(ST7735_SLPOUT);
+      LCD_boot_state = LCD_BOOT_CONFIGURE;
+      LCD_boot_wait(120);
+      break;
+    case LCD_BOOT_CONFIGURE:
+      LCD_configure();
+      LCD_boot_state = LCD_BOOT_FORMAT;
+      LCD_boot_wait(1);
+      break;
+    case LCD_BOOT_FORMAT:
+      LCD_set_format();
+      SPI_changeClock(LCD_boot_spi_hz);
+#if NOKIA5110EMU_FAST_BOOT == 0
+      LCD_set_window(0, 0, ST7735_MAX_X, ST7735_MAX_Y);
+      LCD_boot_row = 0;
+      LCD_boot_state = LCD_BOOT_PATTERN;
+      LCD_boot_wait(1);
+#else
+#if NOKIA5110EMU_FAST_BOOT == 1
+      LCD_fill_border();
+#elif NOKIA5110EMU_SCROLL
+      LCD_fill_sides();
+#endif
+      LCD_boot_state = LCD_BOOT_SHOW;
+#endif
+      break;
+#if NOKIA5110EMU_FAST_BOOT == 0
+    case LCD_BOOT_PATTERN:
+      // send a few rows at a time so the application keeps running
+      LCD_send_pattern(LCD_boot_row, LCD_BOOT_ROWS);
+      LCD_boot_row += LCD_BOOT_ROWS;
+      if ( LCD_boot_row < ST7735_MAX_Y )
+        LCD_boot_wait(1);
+      else
+      {
+#if NOKIA5110EMU_SCROLL
+        LCD_fill_sides();
+#endif
+        LCD_boot_state = LCD_BOOT_SHOW;
+      }
+      break;
+#endif
+  }
+  // Restore the window to it's previous size
+  LCD_window_height = height;
+  LCD_window_width = width;
+}
+#endif
+
+#if NOKIA5110EMU_ASYNC_INIT || NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE
+//============================================================================
+//
+// Timer5A timeout, steps through the LCD bring-up and then sends the paced
+// frames once the timer is ticking at the frame rate, otherwise the sleep
+// timeout has run out
+//
+void Timer5A_Handler(void)
+{
+  TIMER5_ICR_R = TIMER_ICR_TATOCINT; // acknowledge the timeout
+#if NOKIA5110EMU_FRAME_PACING
+  if ( LCD_pace_running )
+  {
+    LCD_pace_tick();
+    return;
+  }
+#endif
+#if NOKIA5110EMU_ASYNC_INIT
+  if ( LCD_boot_state < LCD_BOOT_SHOW )
+  {
+    LCD_boot_step();
+    return;
+  }
+#endif
+#if NOKIA5110EMU_POWER_SAVE
+  LCD_power_sleep();
+#endif
+}
+
+//============================================================================
+//
+//  Initialise Timer5A as a one-shot timer with its timeout interrupt enabled
+//
+void Initialize_Timer5(void)
+{
+	volatile unsigned long temp;
+	SYSCTL_RCGCTIMER_R |= SYSCTL_RCGCTIMER_R5; // Enable Timer5 Clock
+	temp = SYSCTL_RCGCTIMER_R;
+	TIMER5_CTL_R = 0;                       // disable Timer5A during setup
+	TIMER5_CFG_R = TIMER_CFG_32_BIT_TIMER;  // 32-bit timer
+	TIMER5_TAMR_R = TIMER_TAMR_TAMR_1_SHOT; // one-shot, count down
+	TIMER5_TAPR_R = 0;                      // no prescale, SysClk
+	TIMER5_ICR_R = TIMER_ICR_TATOCINT;      // clear any timeout
+	TIMER5_IMR_R = TIMER_IMR_TATOIM;        // interrupt on timeout
+	                                        // priority 7, below SSI2
+	NVIC_PRI23_R = (NVIC_PRI23_R&0xFFFFFF00)|0x000000E0;
+	NVIC_EN2_R = LCD_TIMER_INT_B;           // enable Timer5A interrupt in NVIC
+}
+#endif
+
+#if NOKIA5110EMU_ASYNC_INIT
+
+//********Nokia5110Emu_Ready*****************
+// Check whether the LCD bring-up started by Nokia5110Emu_Init has
+// finished. Until it has, drawing only updates the emulator's copy
+// of the window. The first call to this or any drawing function
+// after the LCD is ready draws the labels and the window contents.
+// inputs: none
+// outputs: 1 when the LCD is ready, 0 while it is being initialised
+int Nokia5110Emu_Ready(void)
+{
+  return !LCD_deferred();
+}
+#endif
+
+//********Nokia5110Emu_Init*****************
+// Replace the Nokia5110 Initialisation with
+// a ST7735 initialisation and draw the external
+// frame surrounding the emulator window
+// With NOKIA5110EMU_ASYNC_INIT this returns before the
+// LCD is ready, see Nokia5110Emu_Ready
+void Nokia5110Emu_Init(void)
+{
+#if NOKIA5110EMU_STATS || NOKIA5110EMU_TRACE
+	// Start the cycle counter used to time waits
+	DEMCR_R |= DEMCR_TRCENA;
+	DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+#endif
+	// Initialize the Launchpad and SPI
+	Initialize_Launchpad();
+#if NOKIA5110EMU_DMA
+	Initialize_UDMA();
+#endif
+	// Display 0 is the emulator window drawn from Screen
+	LCD_ctx = &LCD_context[0];
+	LCD_ctx->buffer = Screen;
+	LCD_ctx->x = NOKIA_WINDOW_X;
+	LCD_ctx->y = NOKIA_WINDOW_Y;
+#if NOKIA5110EMU_MIRROR
+	Initialize_Mirror();
+#endif
+
+#if NOKIA5110EMU_ASYNC_INIT
+	// Start with a blank emulator window which is drawn into the shadow copy
+	// until the LCD is ready, reset is held by Initialize_Launchpad
+	LCD_ctx->cursor_x = 0;
+	LCD_ctx->cursor_y = 0;
+	LCD_window_x = NOKIA_WINDOW_X;
+	LCD_window_y = NOKIA_WINDOW_Y;
+	LCD_window_width = NOKIA_MAX_X;
+	LCD_window_height = NOKIA_MAX_Y;
+	LCD_ctx->spacing = 1;
+	LCD_boot_spi_hz = NOKIA5110EMU_SPI_HZ;
+	LCD_boot_state = LCD_BOOT_WAKE;
+	Nokia5110Emu_Clear();
+	Initialize_Timer5();
+	LCD_boot_wait(1); // 10S min
+#else
+	//Initialize the ST7735 LCD controller
+  Initialize_LCD();
+
+	// Switch to the streaming SSI clock rate
+	Nokia5110Emu_SetSPIClock(NOKIA5110EMU_SPI_HZ);
+	
+	// Initialise static data
+	LCD_ctx->shadow_valid = 0;
+	LCD_ctx->cursor_x = 0;
+  LCD_ctx->cursor_y = 0;
+  LCD_window_x = 0;
+  LCD_window_y = 0;
+
+#if NOKIA5110EMU_FAST_BOOT == 0
+  // Fill full 128x128 ST7735 display with an RGB pattern
+	LCD_resize_window(ST7735_MAX_X, ST7735_MAX_Y);
+	LCD_send_pattern(0, ST7735_MAX_Y);
+#elif NOKIA5110EMU_FAST_BOOT == 1
+	// Fill the border around the emulator window with one colour
+	LCD_fill_border();
+#endif
+#if NOKIA5110EMU_SCROLL && NOKIA5110EMU_FAST_BOOT != 1
+	// The sides of the emulator window scroll with it so must be one colour
+	LCD_fill_sides();
+#endif
+	
+#if NOKIA5110EMU_FAST_BOOT < 2
+	// Display Emulator label
+	LCD_draw_labels();
+#endif
+	LCD_ctx->spacing=1; // Gaps between text maintain backward compatibilty inside emulator window
+
+	// Initialise the Nokia 5110 emulator window
+  Nokia5110Emu_Clear();
+#if NOKIA5110EMU_FRAME_PACING || NOKIA5110EMU_POWER_SAVE
+	// Timer5A only starts once a frame rate or sleep timeout is set
+	Initialize_Timer5();
+#endif
+#endif
+}
+
+//********Nokia5110Emu_OutChar*****************
+// Print a character to the Nokia 5110 84x48 LCD.  The
+// character will be printed at the current cursor position,
+// the cursor will automatically be updated, and it will
+// wrap to the next row or back to the top if necessary.
+// One blank column of pixels will be printed on either side
+// of the character for readability.  Since characters are 8
+// pixels tall and 6 pixels wide, 14 characters fit per row,
+// and there are six rows.
+// inputs: data  character to print
+// outputs: none
+// Note this is slightly more compact than the original which only
+// allowed 12 chars per row
+void Nokia5110Emu_OutChar(unsigned char data)
+{
+  // save the original draw window size
+	uint16_t height = LCD_window_height;
+	uint16_t width = LCD_window_width;
+
+	LCD_TIMER_LOCK();
+	if ( !LCD_deferred() && LCD_DIRECT_TEXT() )
+	{
+		// Reduce the update window to the size of one ascii character
+		LCD_resize_window (CHAR_WIDTH, CHAR_HEIGHT);
+
+		// Write the character data
+#if NOKIA5110EMU_GLYPH_ATLAS
+		LCD_send_packed( ASCII6_atlas[data-' '], sizeof(ASCII6_atlas[0]) );
+#else
+		LCD_send_data( ASCII6[data-' '] );
+#endif
+	}
+
+	// Keep the shadow copy of the emulator window up to date
+	LCD_update_shadow( ASCII6[data-' '], CHAR_WIDTH );
+
+	// Restore the window to it's previous size
+	LCD_window_height = height;
+	LCD_window_width = width;
+
+	// Advance the text cursor to the next character position
+	LCD_advance_cursor(CHAR_WIDTH+LCD_ctx->spacing);
+	LCD_TIMER_UNLOCK();
+}
+
+//********Nokia5110Emu_SetCursor*****************
+// Move the cursor to the desired X- and Y-position.  The
+// next character will be printed here.  X=0 is the leftmost
+// column.  Y=0 is the top row.
+// inputs: newX  new X-position of the cursor (0<=newX<=13)
+//         newY  new Y-position of the cursor (0<=newY<=5)
+// outputs: none
+void Nokia5110Emu_SetCursor(unsigned char newX, unsigned char newY)
+{
+	if ( newX * CHAR_WIDTH + CHAR_WIDTH <= NOKIA_MAX_X )
+		LCD_ctx->cursor_x = newX*(CHAR_WIDTH+LCD_ctx->spacing);
+	if ( newY * CHAR_HEIGHT + CHAR_HEIGHT <= NOKIA_MAX_Y )
+		LCD_ctx->cursor_y = newY*CHAR_HEIGHT;
+}
+
+//********Nokia5110Emu_Clear*****************
+// Clear the LCD by writing off pixels to the emulator window and 
+// reset the text cursor to (0,0) (top left corner of screen).
+// inputs: none
+// outputs: none
+void Nokia5110Emu_Clear(void)
+{
+  int i;
+  LCD_TIMER_LOCK();
+#if NOKIA5110EMU_DMA
+  // the shadow copy is the source of any transfer still in progress
+  LCD_dma_wait();
+#endif
+  // any bank uDMA can not send from one byte is expanded from this
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+    LCD_ctx->shadow[i] = 0;
+  if ( LCD_deferred() )
+  {
+    LCD_ctx->cursor_x = 0;
+    LCD_ctx->cursor_y = 0;
+  }
+  else
+  {
+#if NOKIA5110EMU_SCROLL
+    if ( LCD_scroll_y )
+      LCD_scroll_to(0);
+#endif
+    LCD_reset_window();
+#if NOKIA5110EMU_DMA || NOKIA5110EMU_UPSCALE
+    // every bank is filled on its own, uDMA sends each from a single byte
+#if NOKIA5110EMU_DMA
+    LCD_dma_count = 0;
+#endif
+    for (i = 0; i < SCREENH/8; i++)
+      LCD_fill_span(i, 0, SCREENW-1, 0);
+#if NOKIA5110EMU_DMA
+    LCD_dma_kick();
+#endif
+#else
+    LCD_fill_window(PIXEL_OFF);
+#endif
+  }
+  LCD_ctx->shadow_valid = 1;
+  LCD_MIRROR_CHANGED();
+  LCD_TIMER_UNLOCK();
+}
+
+//********Nokia5110Emu_DrawFullImage*****************
+// Fill the whole screen by drawing a 84x48 bitmap image.
+// inputs: ptr  pointer to 504 byte bitmap
+// outputs: none
+void Nokia5110Emu_DrawFullImage(const char *ptr)
+{
+  int i;
+  LCD_TIMER_LOCK();
+  if ( LCD_deferred() )
+  {
+    LCD_ctx->cursor_x = 0;
+    LCD_ctx->cursor_y = 0;
+    for (i = 0; i < SCREENW*SCREENH/8; i++)
+      LCD_ctx->shadow[i] = ptr[i];
+    LCD_ctx->shadow_valid = 1;
+    LCD_MIRROR_CHANGED();
+    LCD_TIMER_UNLOCK();
+    return;
+  }
+  LCD_STAT(frames, 1);
+#if NOKIA5110EMU_SCROLL
+  // the whole window is sent so it can be put back in screen order
+  if ( LCD_scroll_y )
+    LCD_scroll_to(0);
+#endif
+  LCD_reset_window();
+#if NOKIA5110EMU_DMA || NOKIA5110EMU_UPSCALE
+  // send every bank from the shadow copy so ptr can be reused straight away
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+    LCD_ctx->shadow[i] = ptr[i];
+#if NOKIA5110EMU_DMA
+  LCD_dma_count = 0;
+#endif
+  for (i = 0; i < SCREENH/8; i++)
+    LCD_send_span(i, 0, SCREENW-1);
+#if NOKIA5110EMU_DMA
+  LCD_dma_kick();
+#endif
+#else
+	LCD_send_data(ptr);
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+    LCD_ctx->shadow[i] = ptr[i];
+#endif
+  LCD_ctx->shadow_valid = 1;
+  LCD_MIRROR_CHANGED();
+  LCD_TIMER_UNLOCK();
+}
+
+//********Nokia5110Emu_SetSPIClock*****************
+// Change the SSI2 bit rate used to send data to the LCD. The rate
+// is the fastest the clock dividers can make no faster than hz,
+// limited to SYSTEM_CLOCK_HZ/2, 25MHz and ST7735_MAX_SPI_HZ.
+// Any transfer in progress is allowed to finish first.
+// inputs: hz  requested bit rate, 0 for the fastest allowed
+// outputs: the actual bit rate, or 0 if the LCD is not ready yet
+//          and the rate will be set when it is
+uint32_t Nokia5110Emu_SetSPIClock(uint32_t hz)
+{
+  uint32_t actual;
+#if NOKIA5110EMU_ASYNC_INIT
+  if ( LCD_deferred() )
+  {
+    LCD_boot_spi_hz = hz;
+    return 0;
+  }
+#endif
+  LCD_TIMER_LOCK();
+  actual = SPI_changeClock(hz);
+  LCD_TIMER_UNLOCK();
+  return actual;
+}
+
+//********Nokia5110Emu_GetSPIClock*****************
+// Find the SSI2 bit rate currently used to send data to the LCD
+// inputs: none
+// outputs: bit rate in Hz
+uint32_t Nokia5110Emu_GetSPIClock(void)
+{
+  return SPI_clock_hz;
+}
+
+#if NOKIA5110EMU_DMA
+//********Nokia5110Emu_Busy*****************
+// Check whether the last image is still being sent to the LCD
+// inputs: none
+// outputs: 1 while uDMA is still sending, 0 when finished
+int Nokia5110Emu_Busy(void)
+{
+  return LCD_dma_busy;
+}
+
+//********Nokia5110Emu_WaitDone*****************
+// Wait until the last image has been completely sent to the LCD
+// inputs: none
+// outputs: none
+void Nokia5110Emu_WaitDone(void)
+{
+  LCD_dma_wait();
+}
+
+#if NOKIA5110EMU_DOUBLE_BUFFER
+//********Nokia5110Emu_Flip*****************
+// Make Screen the next frame to be shown without waiting for the
+// frame currently being sent. If the LCD is busy Screen is copied to
+// the front buffer and sent as soon as the current frame finishes
+// (replacing any frame already waiting there), otherwise sending
+// starts straight away. Either way the next frame can be drawn into
+// Screen as soon as this returns.
+// inputs: none
+// outputs: none
+void Nokia5110Emu_Flip(void)
+{
+  int i;
+  NVIC_DIS1_R = LCD_DMA_INT_B;   // keep SSI2_Handler away from the front buffer
+  if ( LCD_dma_busy )
+  {
+    for (i = 0; i < SCREENW*SCREENH/8; i++)
+      LCD_front[i] = Screen[i];
+    LCD_front_pending = 1;
+    NVIC_EN1_R = LCD_DMA_INT_B;
+  }
+  else
+  {
+    LCD_DEFAULT_BEGIN();
+    NVIC_EN1_R = LCD_DMA_INT_B;
+    LCD_update_window(Screen);
+    LCD_DEFAULT_END();
+  }
+}
+#endif
+
+//********Nokia5110Emu_SetDoneCallback*****************
+// Set a function to be called when each image has been completely
+// sent to the LCD. It is called from the SSI2 interrupt handler.
+// inputs: callback  function to call or 0 for none
+// outputs: none
+void Nokia5110Emu_SetDoneCallback(void (*callback)(void))
+{
+  LCD_dma_callback = callback;
+}
+#endif
+
+#if NOKIA5110EMU_TX_QUEUE
+//********Nokia5110Emu_Busy*****************
+// Check whether the transmit queue is still being sent to the LCD
+// inputs: none
+// outputs: 1 while there is still data to send, 0 when finished
+int Nokia5110Emu_Busy(void)
+{
+  return LCD_txq_head != LCD_txq_tail || (SSI2_SR_R&SSI_SR_BSY) == SSI_SR_BSY;
+}
+
+//********Nokia5110Emu_WaitDone*****************
+// Wait until everything in the transmit queue has been sent to the LCD
+// inputs: none
+// outputs: none
+void Nokia5110Emu_WaitDone(void)
+{
+  LCD_txq_wait();
+}
+#endif
+
+//********Nokia5110_Init*****************
+// Pass the command to EDUMKII ST7735 Nokia5110 Emulator
+void Nokia5110_Init(void)
+{
+	Nokia5110Emu_Init();
+}
+
+//********Nokia5110_OutChar*****************
+// Wrapper to the new emulator function
+void Nokia5110_OutChar(unsigned char data)
+{
+#if NOKIA5110EMU_BUFFERED_TEXT
+  LCD_buffer_char(data);
+#else
+  Nokia5110Emu_OutChar(data);
+#endif
+}
+
+//********Nokia5110_OutString*****************
+// Print a string of characters to the Nokia 5110 84x48 LCD.
+// The string will automatically wrap, so padding spaces may
+// be needed to make the output look optimal.
+// Each row of characters is sent to the LCD in a single window.
+// inputs: ptr  pointer to NULL-terminated ASCII string
+// outputs: none
+void Nokia5110_OutString(char *ptr)
+{
+#if NOKIA5110EMU_BUFFERED_TEXT
+  while(*ptr)
+    LCD_buffer_char(*ptr++);
+#else
+  Nokia5110Emu_OutString((unsigned char *)ptr);
+#endif
+}
+
+//********Nokia5110_OutUDec*****************
+// Output a 16-bit number in unsigned decimal format with a
+// fixed size of five right-justified digits of output.
+// Inputs: n  16-bit unsigned number
+// Outputs: none
+void Nokia5110_OutUDec(unsigned short n)
+{
+  char digits[6];
+  // build all five characters so they are sent as one run
+  LCD_udec_string(digits, n);
+  Nokia5110_OutString(digits);
+}
+
+//============================================================================
+//
+// Format n as five right-justified decimal digits into digits[6]
+//
+static void LCD_udec_string(char* digits, unsigned short n)
+{
+  int i;
+  for (i = 4; i >= 0; i--)
+  {
+    if ( n || i == 4 )
+      digits[i] = n%10+'0';
+    else
+      digits[i] = ' ';        // leading zeros are shown as spaces
+    n = n/10;
+  }
+  digits[5] = 0;
+}
+
+//********Nokia5110Emu_OutSDec*****************
+// Output a 16-bit number in signed decimal format with a
+// fixed size of six right-justified characters of output,
+// the minus sign just before the first digit.
+// Inputs: n  16-bit signed number
+// Outputs: none
+void Nokia5110Emu_OutSDec(short n)
+{
+  char digits[7];
+  LCD_sdec_string(digits, n);
+  Nokia5110_OutString(digits);
+}
+
+//********Nokia5110Emu_OutUHex*****************
+// Output a 16-bit number in hexadecimal format with a
+// fixed size of four digits including leading zeros.
+// Inputs: n  16-bit unsigned number
+// Outputs: none
+void Nokia5110Emu_OutUHex(unsigned short n)
+{
+  char digits[5];
+  int i;
+  for (i = 3; i >= 0; i--)
+  {
+    digits[i] = "0123456789ABCDEF"[n&0xF];
+    n = n >> 4;
+  }
+  digits[4] = 0;
+  Nokia5110_OutString(digits);
+}
+
+//********Nokia5110Emu_OutFix*****************
+// Output a signed fixed-point number with a decimal point
+// before the last decimals digits, e.g. 1234 with 2 decimals
+// is 12.34 and -5 with 2 decimals is -0.05. The output is as
+// wide as the number needs.
+// Inputs: n         value in units of 10^-decimals
+//         decimals  digits after the decimal point, 0 to 9
+// Outputs: none
+void Nokia5110Emu_OutFix(long n, unsigned char decimals)
+{
+  char digits[LCD_FIX_CHARS];
+  LCD_fix_string(digits, n, decimals);
+  Nokia5110_OutString(digits);
+}
+
+//============================================================================
+//
+// Format n as five right-justified decimal digits after a column for the
+// sign into digits[7]
+//
+static void LCD_sdec_string(char* digits, short n)
+{
+  int i;
+  LCD_udec_string(&digits[1], n < 0 ? -n : n);
+  digits[0] = ' ';
+  if ( n < 0 )
+  {
+    for (i = 1; digits[i] == ' '; i++) {};
+    digits[i-1] = '-';        // just before the first digit
+  }
+}
+
+//============================================================================
+//
+// Format n as a fixed-point number with decimals digits after the decimal
+// point into out, which needs room for LCD_FIX_CHARS characters
+//
+static void LCD_fix_string(char* out, long n, unsigned char decimals)
+{
+  char digits[LCD_FIX_DIGITS]; // digits of the magnitude, least significant first
+  unsigned long u = n < 0 ? 0UL - (unsigned long)n : (unsigned long)n;
+  int count = 0;
+  if ( decimals > 9 )
+    decimals = 9;
+  // always at least one digit before the decimal point
+  do
+  {
+    digits[count++] = u%10+'0';
+    u = u/10;
+  } while ( u || count <= decimals );
+  if ( n < 0 )
+    *out++ = '-';
+  while ( count )
+  {
+    if ( count == decimals )
+      *out++ = '.';
+    *out++ = digits[--count];
+  }
+  *out = 0;
+}
+
+#if NOKIA5110EMU_BUFFERED_TEXT
+//============================================================================
+//
+// Draw a character and its spacing columns into Screen at the text cursor
+// and move the cursor on, wrapping to the next row or back to the top
+//
+static void LCD_buffer_char(unsigned char data)
+{
+  uint16_t i;
+  char *dest = &LCD_ctx->buffer[LCD_ctx->cursor_y/8*SCREENW + LCD_ctx->cursor_x];
+  for (i = 0; i < CHAR_WIDTH+LCD_ctx->spacing && LCD_ctx->cursor_x + i < SCREENW; i++)
+    dest[i] = i < CHAR_WIDTH ? ASCII6[data-' '][i] : 0;
+  LCD_ctx->cursor_x += CHAR_WIDTH+LCD_ctx->spacing;
+  if ( LCD_ctx->cursor_x + CHAR_WIDTH+LCD_ctx->spacing > SCREENW )
+  {
+    LCD_ctx->cursor_x = 0;
+    LCD_ctx->cursor_y += CHAR_HEIGHT;
+    if ( LCD_ctx->cursor_y + CHAR_HEIGHT > SCREENH )
+      LCD_ctx->cursor_y = 0;
+  }
+}
+#endif
+
+//********Nokia5110_SetCursor*****************
+// Wrapper to new emulator function
+void Nokia5110_SetCursor(unsigned char newX, unsigned char newY)
+{
+  Nokia5110Emu_SetCursor(newX, newY);
+}
+
+//********Nokia5110_Clear*****************
+// Clear the LCD by writing zeros to the entire screen and
+// reset the cursor to (0,0) (top left corner of screen).
+// With NOKIA5110EMU_BUFFERED_TEXT only Screen is cleared, or the
+// frame buffer of the display selected with NOKIA5110EMU_DISPLAYS.
+// inputs: none
+// outputs: none
+void Nokia5110_Clear(void)
+{
+#if NOKIA5110EMU_BUFFERED_TEXT
+  int i;
+  for(i=0; i<SCREENW*SCREENH/8; i++)
+    LCD_ctx->buffer[i] = 0; // clear buffer
+  Nokia5110_SetCursor(0, 0);
+#else
+  Nokia5110Emu_Clear();
+#endif
+}
+
+//********Nokia5110_DrawFullImage*****************
+// Fill the whole screen by drawing a 48x84 bitmap image.
+// inputs: ptr  pointer to 504 byte bitmap
+// outputs: none
+// assumes: LCD is in default horizontal addressing mode (V = 0)
+void Nokia5110_DrawFullImage(const char *ptr)
+{
+  Nokia5110_SetCursor(0, 0);
+  Nokia5110Emu_DrawFullImage(ptr);
+}
+
+//********Nokia5110_PrintBMP*****************
+// Bitmaps defined above were created for the LM3S1968 or
+// LM3S8962's 4-bit grayscale OLED display.  They also
+// still contain their header data and may contain padding
+// to preserve 4-byte alignment.  This function takes a
+// bitmap in the previously described format and puts its
+// image data in the proper location in the buffer so the
+// image will appear on the screen after the next call to
+//   Nokia5110_DisplayBuffer();
+// The interface and operation of this process is modeled
+// after RIT128x96x4_BMP(x, y, image);
+// inputs: xpos      horizontal position of bottom left corner of image, columns from the left edge
+//                     must be less than 84
+//                     0 is on the left; 82 is near the right
+//         ypos      vertical position of bottom left corner of image, rows from the top edge
+//                     must be less than 48
+//                     2 is near the top; 47 is at the bottom
+//         ptr       pointer to a 16 color BMP image
+//         threshold grayscale colors above this number make corresponding pixel 'on'
+//                     0 to 14
+//                     0 is fine for ships, explosions, projectiles, and bunkers
+// outputs: none
+// With NOKIA5110EMU_SPRITES images drawn every frame are much quicker to
+// convert once with Nokia5110Emu_ConvertBMP and draw with Nokia5110Emu_DrawSprite
+void Nokia5110_PrintBMP(unsigned char xpos, unsigned char ypos, const unsigned char *ptr, unsigned char threshold)
+{
+  long width = ptr[18], height = ptr[22], i, j;
+  unsigned short screenx, screeny;
+  unsigned char mask;
+  // check for clipping
+  if((height <= 0) ||              // bitmap is unexpectedly encoded in top-to-bottom pixel order
+     ((width%2) != 0) ||           // must be even number of columns
+     ((xpos + width) > SCREENW) || // right side cut off
+     (ypos < (height - 1)) ||      // top cut off
+     (ypos > SCREENH))           { // bottom cut off
+    return;
+  }
+  if(threshold > 14){
+    threshold = 14;             // only full 'on' turns pixel on
+  }
+  // bitmaps are encoded backwards, so start at the bottom left corner of the image
+  screeny = ypos/8;
+  screenx = xpos + SCREENW*screeny;
+  mask = ypos%8;                // row 0 to 7
+  mask = 0x01<<mask;            // now stores a mask 0x01 to 0x80
+  j = ptr[10];                  // byte 10 contains the offset where image data can be found
+  for(i=1; i<=(width*height/2); i=i+1){
+    // the left pixel is in the upper 4 bits
+    if(((ptr[j]>>4)&0xF) > threshold){
+      Screen[screenx] |= mask;
+    } else{
+      Screen[screenx] &= ~mask;
+    }
+    screenx = screenx + 1;
+    // the right pixel is in the lower 4 bits
+    if((ptr[j]&0xF) > threshold){
+      Screen[screenx] |= mask;
+    } else{
+      Screen[screenx] &= ~mask;
+    }
+    screenx = screenx + 1;
+    j = j + 1;
+    if((i%(width/2)) == 0){     // at the end of a row
+      if(mask > 0x01){
+        mask = mask>>1;
+      } else{
+        mask = 0x80;
+        screeny = screeny - 1;
+      }
+      screenx = xpos + SCREENW*screeny;
+      // bitmaps are 32-bit word aligned
+      switch((width/2)%4){      // skip any padding
+        case 0: j = j + 0; break;
+        case 1: j = j + 3; break;
+        case 2: j = j + 2; break;
+        case 3: j = j + 1; break;
+      }
+    }
+  }
+}
+
+#if NOKIA5110EMU_SPRITES
+//********Nokia5110Emu_ConvertBMP*****************
+// Convert a 16 color BMP image in the format taken by
+// Nokia5110_PrintBMP into a sprite for Nokia5110Emu_DrawSprite.
+// Each pixel is thresholded once here instead of on every draw
+// and the mask covers the whole image, like Nokia5110_PrintBMP.
+// inputs: sprite    sprite to fill in
+//         data      NOKIA5110EMU_SPRITE_BYTES(width, height) bytes for the
+//                     converted image, which must be kept for as long as
+//                     the sprite is used
+//         ptr       pointer to a 16 color BMP image
+//         threshold grayscale colors above this number make corresponding pixel 'on'
+//                     0 to 14
+// outputs: bytes of data used, or 0 if the image can not be converted
+int Nokia5110Emu_ConvertBMP(struct Nokia5110Emu_Sprite *sprite, uint8_t *data, const unsigned char *ptr, unsigned char threshold)
+{
+  long width = ptr[18], height = ptr[22];
+  long stride = ((width+1)/2 + 3) & ~3; // bytes per row, rows are 32-bit word aligned
+  const unsigned char *image = &ptr[ptr[10]]; // byte 10 contains the offset of the image data
+  uint8_t banks = (height+7)/8;
+  uint8_t *mask = &data[banks*width];
+  long row, col;
+  if ( height <= 0 || width <= 0 ) // bitmap is unexpectedly encoded in top-to-bottom pixel order
+    return 0;
+  if ( threshold > 14 )
+    threshold = 14;                // only full 'on' turns pixel on
+  for (col = 0; col < 2*banks*width; col++)
+    data[col] = 0;
+  for (row = 0; row < height; row++)
+  {
+    // bitmaps are encoded backwards, so the top row is the last one
+    const unsigned char *line = &image[(height - 1 - row)*stride];
+    uint8_t bit = 1 << (row%8);
+    uint16_t bank = row/8*width;
+    for (col = 0; col < width; col++)
+    {
+      // the left pixel is in the upper 4 bits
+      uint8_t colour = (col&1) ? line[col/2]&0xF : line[col/2]>>4;
+      if ( colour > threshold )
+        data[bank + col] |= bit;
+      mask[bank + col] |= bit;
+    }
+  }
+  sprite->width = width;
+  sprite->height = height;
+  sprite->banks = banks;
+  sprite->data = data;
+  return 2*banks*width;
+}
+
+//********Nokia5110Emu_DrawSprite*****************
+// Draw a sprite into the buffer so it will appear on the screen
+// after the next call to Nokia5110_DisplayBuffer. Each byte of the
+// sprite is shifted down to the row it is drawn at and combined
+// with the two banks of the buffer it falls across. Parts of the
+// sprite off the edge of the screen are not drawn.
+// inputs: x       column of the left edge of the sprite, may be negative
+//         y       row of the top edge of the sprite, may be negative
+//         sprite  sprite to draw
+//         mode    NOKIA5110EMU_BLIT_COPY, _OR, _AND or _XOR
+// outputs: none
+void Nokia5110Emu_DrawSprite(int x, int y, const struct Nokia5110Emu_Sprite *sprite, int mode)
+{
+  uint8_t shift = y & 7;                  // rows down from the top of a bank
+  int top = (y - shift)/8;                // bank of Screen the sprite starts in
+  int first = x < 0 ? -x : 0;             // first and one past the last column on screen
+  int last = x + sprite->width > SCREENW ? SCREENW - x : sprite->width;
+  int b, col;
+  for (b = 0; b < sprite->banks; b++)
+  {
+    const uint8_t *pixels = &sprite->data[b*sprite->width];
+    const uint8_t *mask = &pixels[sprite->banks*sprite->width];
+    int upper = top + b; // bank the top of this sprite bank falls in
+    int lower = upper + 1;
+    if ( upper < 0 || upper >= SCREENH/8 )
+      upper = -1;  // off screen
+    if ( shift == 0 || lower < 0 || lower >= SCREENH/8 )
+      lower = -1;  // not needed or off screen
+    for (col = first; col < last; col++)
+    {
+      uint16_t p = pixels[col] << shift;
+      uint16_t m = mask[col] << shift;
+      if ( upper >= 0 )
+        LCD_blit(&Screen[upper*SCREENW + x + col], p, m, mode);
+      if ( lower >= 0 )
+        LCD_blit(&Screen[lower*SCREENW + x + col], p >> 8, m >> 8, mode);
+    }
+  }
+}
+
+//============================================================================
+//
+// Combine one byte of a sprite with one byte of Screen
+//
+static void LCD_blit(char *dest, uint8_t pixels, uint8_t mask, int mode)
+{
+  switch ( mode )
+  {
+    case NOKIA5110EMU_BLIT_COPY: *dest = (*dest & ~mask) | (pixels & mask); break;
+    case NOKIA5110EMU_BLIT_OR:   *dest |= pixels; break;
+    case NOKIA5110EMU_BLIT_AND:  *dest &= pixels | ~mask; break;
+    case NOKIA5110EMU_BLIT_XOR:  *dest ^= pixels; break;
+  }
+}
+#endif
+
+#if NOKIA5110EMU_RASTER
+//============================================================================
+//
+//  Raster operations
+//  Each bank of Screen starts on a word boundary so the columns of a bank
+//  can be worked on four at a time, with the same row mask in every byte of
+//  the word. Everything is drawn into Screen and Nokia5110_DisplayBuffer
+//  sends only the spans which really changed.
+//
+#define LCD_ROP_CLEAR  0 // turn the pixels off
+#define LCD_ROP_SET    1 // turn the pixels on
+#define LCD_ROP_INVERT 2 // invert the pixels
+#define LCD_ROP(DEST, MASK, OP) ((OP) == LCD_ROP_SET ? ((DEST) |= (MASK)) : \
+                                 (OP) == LCD_ROP_CLEAR ? ((DEST) &= ~(MASK)) : ((DEST) ^= (MASK)))
+
+//********Nokia5110Emu_FillRect*****************
+// Turn every pixel of a rectangle in the buffer on or off, a
+// height of 1 draws a horizontal line. The part of the
+// rectangle off the edge of the screen is ignored.
+// inputs: x       column of the left edge, may be negative
+//         y       row of the top edge, may be negative
+//         width   columns
+//         height  rows
+//         on      1 to turn the pixels on, 0 to turn them off
+// outputs: none
+void Nokia5110Emu_FillRect(int x, int y, int width, int height, int on)
+{
+  LCD_raster_rect(x, y, width, height, on ? LCD_ROP_SET : LCD_ROP_CLEAR);
+}
+
+//********Nokia5110Emu_InvertRect*****************
+// Invert every pixel of a rectangle in the buffer. The part of
+// the rectangle off the edge of the screen is ignored.
+// inputs: x       column of the left edge, may be negative
+//         y       row of the top edge, may be negative
+//         width   columns
+//         height  rows
+// outputs: none
+void Nokia5110Emu_InvertRect(int x, int y, int width, int height)
+{
+  LCD_raster_rect(x, y, width, height, LCD_ROP_INVERT);
+}
+
+//********Nokia5110Emu_ScrollBuffer*****************
+// Move the image in the buffer dx columns right and dy rows
+// down, negative values move it left and up. Pixels moved off
+// the screen are lost and the pixels uncovered are turned off.
+// inputs: dx  columns to move right
+//         dy  rows to move down
+// outputs: none
+void Nokia5110Emu_ScrollBuffer(int dx, int dy)
+{
+  uint32_t *words = (uint32_t *)Screen;
+  const int pitch = SCREENW/4;            // words per bank
+  int n = dy < 0 ? -dy : dy;
+  int k = n/8, r = n%8;                   // whole banks and rows within a bank
+  int bank, i;
+  if ( dy < 0 )
+  {
+    // each row comes from n rows below, the bits shifted out of the top of
+    // each byte are filled from the bank below that
+    uint32_t keep = LCD_LANES(0xFF >> r);
+    for (bank = 0; bank < SCREENH/8; bank++)
+      for (i = 0; i < pitch; i++)
+      {
+        uint32_t a = bank + k < SCREENH/8 ? words[(bank + k)*pitch + i] : 0;
+        uint32_t b = bank + k + 1 < SCREENH/8 ? words[(bank + k + 1)*pitch + i] : 0;
+        words[bank*pitch + i] = ((a >> r) & keep) | ((b << (8 - r)) & ~keep);
+      }
+  }
+  else if ( dy > 0 )
+  {
+    // each row comes from n rows above, working up from the bottom bank
+    uint32_t keep = LCD_LANES(0xFF << r);
+    for (bank = SCREENH/8 - 1; bank >= 0; bank--)
+      for (i = 0; i < pitch; i++)
+      {
+        uint32_t a = bank - k >= 0 ? words[(bank - k)*pitch + i] : 0;
+        uint32_t b = bank - k - 1 >= 0 ? words[(bank - k - 1)*pitch + i] : 0;
+        words[bank*pitch + i] = ((a << r) & keep) | ((b >> (8 - r)) & ~keep);
+      }
+  }
+  if ( dx > 0 )
+    for (bank = 0; bank < SCREENH/8; bank++)
+    {
+      char *row = &Screen[bank*SCREENW];
+      for (i = SCREENW - 1; i >= 0; i--)
+        row[i] = i >= dx ? row[i - dx] : 0;
+    }
+  else if ( dx < 0 )
+    for (bank = 0; bank < SCREENH/8; bank++)
+    {
+      char *row = &Screen[bank*SCREENW];
+      for (i = 0; i < SCREENW; i++)
+        row[i] = i - dx < SCREENW ? row[i - dx] : 0;
+    }
+}
+
+//********Nokia5110Emu_CopyMasked*****************
+// Copy the pixels of a 84x48 image into the buffer wherever the
+// mask has a pixel on, leaving the rest of the buffer alone.
+// Word aligned images are copied a word at a time.
+// inputs: src   pointer to 504 byte bitmap to copy from
+//         mask  pointer to 504 byte bitmap of the pixels to copy
+// outputs: none
+void Nokia5110Emu_CopyMasked(const char *src, const char *mask)
+{
+  int i;
+  if ( (((uintptr_t)src | (uintptr_t)mask) & 3) == 0 )
+  {
+    uint32_t *dest = (uint32_t *)Screen;
+    const uint32_t *s = (const uint32_t *)src;
+    const uint32_t *m = (const uint32_t *)mask;
+    for (i = 0; i < SCREENW*SCREENH/32; i++)
+      dest[i] = (dest[i] & ~m[i]) | (s[i] & m[i]);
+  }
+  else
+    for (i = 0; i < SCREENW*SCREENH/8; i++)
+      Screen[i] = (Screen[i] & ~mask[i]) | (src[i] & mask[i]);
+}
+
+//============================================================================
+//
+// Apply a raster operation to a rectangle of Screen clipped to the screen,
+// one bank at a time with a mask of the rows of the bank it covers
+//
+static void LCD_raster_rect(int x, int y, int width, int height, uint8_t op)
+{
+  int bank, top, bottom;
+  if ( x < 0 ) { width += x; x = 0; }
+  if ( y < 0 ) { height += y; y = 0; }
+  if ( x + width > SCREENW ) width = SCREENW - x;
+  if ( y + height > SCREENH ) height = SCREENH - y;
+  if ( width <= 0 || height <= 0 )
+    return;
+  for (bank = y/8; bank <= (y + height - 1)/8; bank++)
+  {
+    // first and last rows of the rectangle within this bank
+    top = y > bank*8 ? y - bank*8 : 0;
+    bottom = y + height < bank*8 + 8 ? y + height - 1 - bank*8 : 7;
+    LCD_raster_span(&Screen[bank*SCREENW + x], width, (0xFF << top) & (0xFF >> (7 - bottom)), op);
+  }
+}
+
+//============================================================================
+//
+// Apply a raster operation to the mask rows of count columns of one bank,
+// a byte at a time up to a word boundary then a word at a time
+//
+static void LCD_raster_span(char* dest, uint16_t count, uint8_t mask, uint8_t op)
+{
+  uint32_t lanes = LCD_LANES(mask);
+  for (; count && ((uintptr_t)dest & 3); count--, dest++)
+    LCD_ROP(*dest, mask, op);
+  for (; count >= 4; count -= 4, dest += 4)
+    LCD_ROP(*(uint32_t *)dest, lanes, op);
+  for (; count; count--, dest++)
+    LCD_ROP(*dest, mask, op);
+}
+#endif
+
+// There is a buffer in RAM that holds one screen
+// This routine clears this buffer a word at a time
+void Nokia5110_ClearBuffer(void)
+{
+	int i;
+  for(i=0; i<SCREENW*SCREENH/32; i++)
+    ((uint32_t *)Screen)[i] = 0; // clear buffer
+}
+
+//********Nokia5110_DisplayBuffer*****************
+// Fill the whole screen by drawing a 84x48 screen image.
+// Only the parts of the screen which changed since the last
+// update are actually sent to the LCD.
+// With NOKIA5110EMU_FRAME_PACING this is Nokia5110Emu_Present.
+// inputs: none
+// outputs: none
+// assumes: LCD is in default horizontal addressing mode (V = 0)
+void Nokia5110_DisplayBuffer(void)
+{
+  LCD_DEFAULT_BEGIN();
+#if NOKIA5110EMU_STATS_OVERLAY
+  // refresh the statistics below the emulator window once a second
+  if ( DWT_CYCCNT_R - LCD_stats_time >= SYSTEM_CLOCK_HZ )
+    Nokia5110Emu_DrawStats();
+#endif
+  if ( LCD_ctx->shadow_valid )
+  {
+    Nokia5110_SetCursor(0, 0);
+#if NOKIA5110EMU_FRAME_PACING
+    Nokia5110Emu_Present(Screen);
+#elif NOKIA5110EMU_DOUBLE_BUFFER
+    LCD_TIMER_LOCK();
+    Nokia5110Emu_Flip();
+    LCD_TIMER_UNLOCK();
+#else
+    LCD_TIMER_LOCK();
+    LCD_update_window(Screen);
+    LCD_TIMER_UNLOCK();
+#endif
+  }
+  else
+    Nokia5110_DrawFullImage(Screen);
+  LCD_DEFAULT_END();
+}
+
+#if NOKIA5110EMU_DISPLAYS > 1
+//============================================================================
+//
+//  Virtual displays
+//  Each display is a Nokia5110 window somewhere on the ST7735 with its own
+//  frame buffer, shadow copy and text cursor. The text and drawing functions
+//  draw on the selected one, the functions which work on Screen always draw
+//  on display 0. Nokia5110Emu_FlushDisplays sends what changed in every
+//  frame buffer at once, merging changed banks which meet on the ST7735
+//  into one window whenever that sends fewer bytes.
+//
+
+//********Nokia5110Emu_OpenDisplay*****************
+// Add a cleared 84x48 display with its top left corner at ST7735
+// pixel (x,y). Displays should not overlap each other.
+// inputs: buffer  504 byte frame buffer laid out like Screen
+//         x, y    position on the ST7735
+// outputs: display number for Nokia5110Emu_SelectDisplay,
+//          0 if there is no room for it
+int Nokia5110Emu_OpenDisplay(char *buffer, unsigned char x, unsigned char y)
+{
+  struct LCD_context *ctx = LCD_ctx;
+  int d, i;
+  if ( x + NOKIA_MAX_X > ST7735_MAX_X || y + NOKIA_MAX_Y > ST7735_MAX_Y )
+    return 0;
+  for (d = 1; d < NOKIA5110EMU_DISPLAYS && LCD_context[d].buffer; d++) {};
+  if ( d == NOKIA5110EMU_DISPLAYS )
+    return 0;
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+    buffer[i] = 0;
+  LCD_context[d].x = x;
+  LCD_context[d].y = y;
+  LCD_context[d].spacing = 1;
+  LCD_context[d].buffer = buffer;
+  Nokia5110Emu_SelectDisplay(d);
+  Nokia5110Emu_Clear();
+  Nokia5110Emu_SelectDisplay(ctx - LCD_context);
+  return d;
+}
+
+//********Nokia5110Emu_MoveDisplay*****************
+// Move a display to ST7735 pixel (x,y) and draw it there. Where
+// it was is left as it is.
+// inputs: display  display number, 0 for the emulator window
+//         x, y     new position on the ST7735
+// outputs: none
+void Nokia5110Emu_MoveDisplay(int display, unsigned char x, unsigned char y)
+{
+  struct LCD_context *ctx = LCD_ctx;
+  uint8_t cursor_x, cursor_y;
+  if ( display < 0 || display >= NOKIA5110EMU_DISPLAYS || !LCD_context[display].buffer ||
+       x + NOKIA_MAX_X > ST7735_MAX_X || y + NOKIA_MAX_Y > ST7735_MAX_Y )
+    return;
+  Nokia5110Emu_SelectDisplay(display);
+  LCD_TIMER_LOCK();
+#if NOKIA5110EMU_DMA
+  // regions still being sent were placed at the old position
+  LCD_dma_wait();
+#endif
+  LCD_ctx->x = x;
+  LCD_ctx->y = y;
+  LCD_TIMER_UNLOCK();
+  cursor_x = LCD_ctx->cursor_x;
+  cursor_y = LCD_ctx->cursor_y;
+  Nokia5110Emu_DrawFullImage(LCD_ctx->shadow);
+  LCD_ctx->cursor_x = cursor_x;
+  LCD_ctx->cursor_y = cursor_y;
+  Nokia5110Emu_SelectDisplay(ctx - LCD_context);
+}
+
+//********Nokia5110Emu_SelectDisplay*****************
+// Choose the display the text and drawing functions draw on. Each
+// display keeps its own text cursor. Displays which have not been
+// opened are ignored.
+// inputs: display  display number, 0 for the emulator window
+// outputs: none
+void Nokia5110Emu_SelectDisplay(int display)
+{
+  if ( display < 0 || display >= NOKIA5110EMU_DISPLAYS || !LCD_context[display].buffer )
+    return;
+  LCD_TIMER_LOCK();
+  LCD_ctx = &LCD_context[display];
+  LCD_window_x = LCD_ctx->x;
+  LCD_window_y = LCD_ctx->y;
+  LCD_window_width = NOKIA_MAX_X;
+  LCD_window_height = NOKIA_MAX_Y;
+  LCD_TIMER_UNLOCK();
+}
+
+//********Nokia5110Emu_FlushDisplays*****************
+// Send the parts of every display's frame buffer which changed
+// since they were last sent, Screen for display 0. Changed banks
+// next to each other on the ST7735 share one window when that is
+// fewer bytes than a window each.
+// inputs: none
+// outputs: none
+void Nokia5110Emu_FlushDisplays(void)
+{
+  struct LCD_slot slot[NOKIA5110EMU_DISPLAYS*SCREENH/8];
+  struct LCD_context *order[NOKIA5110EMU_DISPLAYS];
+  struct LCD_context *ctx = LCD_ctx;
+  uint16_t count = 0, first, last, i, j, n;
+
+  // the open displays from the top of the ST7735 down
+  for (i = n = 0; i < NOKIA5110EMU_DISPLAYS; i++)
+    if ( LCD_context[i].buffer )
+    {
+      for (j = n++; j > 0 && order[j-1]->y > LCD_context[i].y; j--)
+        order[j] = order[j-1];
+      order[j] = &LCD_context[i];
+    }
+
+  LCD_TIMER_LOCK();
+  if ( LCD_deferred() )
+  {
+    // every shadow copy is sent once the LCD is ready
+    for (i = 0; i < n; i++)
+      for (j = 0; j < SCREENW*SCREENH/8; j++)
+        order[i]->shadow[j] = order[i]->buffer[j];
+    LCD_MIRROR_KICK();
+    LCD_TIMER_UNLOCK();
+    return;
+  }
+  LCD_STAT(frames, 1);
+#if NOKIA5110EMU_DMA
+  // the shadow copies are the source of the transfer so must not be changed
+  LCD_dma_wait();
+  LCD_dma_count = 0;
+#endif
+  for (i = 0; i < n; i++)
+    for (j = 0; j < SCREENH/8; j++, count++)
+    {
+      slot[count].ctx = order[i];
+      slot[count].bank = j;
+      slot[count].dirty = order[i]->shadow_valid ?
+          LCD_find_span(&order[i]->buffer[j*SCREENW], &order[i]->shadow[j*SCREENW],
+                        &slot[count].first, &slot[count].last) : 1;
+      if ( !order[i]->shadow_valid )
+      {
+        slot[count].first = 0;
+        slot[count].last = SCREENW-1;
+      }
+      // window width must be even so align the span to pixel pairs
+      slot[count].first &= ~1;
+      slot[count].last |= 1;
+    }
+
+  for (i = 0; i < count; i = j)
+  {
+    if ( !slot[i].dirty )
+    {
+      j = i + 1;
+      continue;
+    }
+    // add the changed banks straight below while one window costs less
+    first = slot[i].first;
+    last = slot[i].last;
+    for (j = i + 1; j < count && slot[j].dirty &&
+         slot[j].ctx->x == slot[j-1].ctx->x &&
+         slot[j].ctx->y + slot[j].bank*8 == slot[j-1].ctx->y + slot[j-1].bank*8 + 8; j++)
+    {
+      uint16_t f = slot[j].first < first ? slot[j].first : first;
+      uint16_t l = slot[j].last > last ? slot[j].last : last;
+      uint32_t merged = LCD_WINDOW_BYTES + (uint32_t)(l - f + 1)*(j - i + 1)*8*3/2;
+      uint32_t apart = 2*LCD_WINDOW_BYTES + (uint32_t)(last - first + 1)*(j - i)*8*3/2
+                     + (uint32_t)(slot[j].last - slot[j].first + 1)*8*3/2;
+      if ( merged > apart )
+        break;
+      first = f;
+      last = l;
+    }
+    LCD_flush_window(&slot[i], j - i, first, last);
+  }
+  for (i = 0; i < n; i++)
+    order[i]->shadow_valid = 1;
+#if NOKIA5110EMU_DMA
+  LCD_dma_kick();
+#endif
+  LCD_ctx = ctx;
+  LCD_MIRROR_KICK();
+  LCD_TIMER_UNLOCK();
+}
+
+//============================================================================
+//
+// Send columns first to last of count banks in a row down the ST7735 in one
+// window, after copying them from each display's frame buffer to its shadow
+// copy. A single bank is sent as a span so it can still be a solid fill
+//
+static void LCD_flush_window(const struct LCD_slot* slot, uint16_t count, uint16_t first, uint16_t last)
+{
+  uint16_t k, i;
+#if !NOKIA5110EMU_DMA
+  // save the original draw window size
+  uint16_t height = LCD_window_height;
+  uint16_t width = LCD_window_width;
+#endif
+  for (k = 0; k < count; k++)
+  {
+    const char *new_bank = &slot[k].ctx->buffer[slot[k].bank*SCREENW];
+    char *old_bank = &slot[k].ctx->shadow[slot[k].bank*SCREENW];
+    for (i = first; i <= last; i++)
+      old_bank[i] = new_bank[i];
+  }
+  if ( count == 1 )
+  {
+    LCD_ctx = slot[0].ctx;
+    LCD_send_span(slot[0].bank, first, last);
+    return;
+  }
+#if NOKIA5110EMU_DMA
+  // one region per bank, only the first opens the window
+  for (k = 0; k < count; k++)
+  {
+    LCD_ctx = slot[k].ctx;
+    LCD_dma_add(slot[k].bank, first, last, 0, 0);
+    LCD_dma_region[LCD_dma_count-1].rows = k ? 0 : count*8;
+  }
+#else
+  LCD_span_window(slot[0].ctx, slot[0].bank, first, last, count*8);
+  // the banks follow on from each other in the same RAMWR
+  LCD_window_height = 8;
+  for (k = 0; k < count; k++)
+    LCD_send_region(&slot[k].ctx->shadow[slot[k].bank*SCREENW + first], SCREENW);
+
+  // Restore the window to it's previous size
+  LCD_window_height = height;
+  LCD_window_width = width;
+#endif
+}
+#endif
+
+#if NOKIA5110EMU_FRAME_PACING
+//============================================================================
+//
+//  Frame pacing
+//  Frames presented faster than the panel can show them are never seen, so
+//  Nokia5110Emu_Present only keeps the latest one and Timer5A sends it on the
+//  next tick. Drawing functions called by the application hold the tick off
+//  until they have finished with the LCD.
+//
+
+//********Nokia5110Emu_SetFrameRate*****************
+// Start sending presented frames to the LCD at no more than hz
+// frames per second. Frames are never sent faster than the panel
+// refresh rate set by FRMCTR1.
+// inputs: hz  frames per second, 0 for the panel refresh rate
+// outputs: the frame rate used
+uint32_t Nokia5110Emu_SetFrameRate(uint32_t hz)
+{
+  if ( hz == 0 || hz > LCD_PANEL_HZ )
+    hz = LCD_PANEL_HZ;
+  LCD_pace_hz = hz;
+  if ( !LCD_deferred() )
+    LCD_pace_start();
+  return hz;
+}
+
+//********Nokia5110Emu_Present*****************
+// Hand a 84x48 frame to be shown on the next frame pacing tick,
+// replacing any frame presented since the last tick. The frame is
+// copied so it can be drawn into again straight away. Before a
+// frame rate is set the frame is sent straight away.
+// inputs: frame  pointer to 504 byte bitmap
+// outputs: none
+void Nokia5110Emu_Present(const char *frame)
+{
+  int i;
+  if ( !LCD_pace_running )
+  {
+    LCD_DEFAULT_BEGIN();
+    LCD_TIMER_LOCK();
+    LCD_update_window(frame);
+    LCD_TIMER_UNLOCK();
+    LCD_DEFAULT_END();
+    return;
+  }
+  LCD_TIMER_LOCK();
+  LCD_pace_stats.presented++;
+  if ( LCD_pace_pending )
+    LCD_pace_stats.coalesced++;
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+    LCD_pace_frame[i] = frame[i];
+  LCD_pace_pending = 1;
+  LCD_TIMER_UNLOCK();
+}
+
+//********Nokia5110Emu_GetPaceStats*****************
+// Copy the frame pacing counters
+// inputs: stats  where to copy them
+// outputs: none
+void Nokia5110Emu_GetPaceStats(struct Nokia5110Emu_PaceStats *stats)
+{
+  LCD_TIMER_LOCK();
+  *stats = LCD_pace_stats;
+  LCD_TIMER_UNLOCK();
+}
+
+//============================================================================
+//
+// Switch Timer5A to periodic timeouts at the frame rate
+//
+static void LCD_pace_start(void)
+{
+  TIMER5_CTL_R = 0;                       // disable Timer5A during setup
+  TIMER5_TAMR_R = TIMER_TAMR_TAMR_PERIOD; // periodic, count down
+  TIMER5_TAILR_R = SYSTEM_CLOCK_HZ/LCD_pace_hz - 1;
+  LCD_pace_running = 1;
+  TIMER5_CTL_R |= TIMER_CTL_TAEN;
+}
+
+//============================================================================
+//
+// Send the latest presented frame, called from Timer5A_Handler
+// A frame still being sent by uDMA is left to finish and the new one is sent
+// on the next tick instead
+//
+static void LCD_pace_tick(void)
+{
+  if ( !LCD_pace_pending )
+  {
+#if NOKIA5110EMU_POWER_SAVE
+    // count the ticks without drawing towards the sleep timeout
+    if ( LCD_power_ms && !LCD_asleep && ++LCD_power_ticks >= LCD_power_ms*LCD_pace_hz/1000 )
+      LCD_power_sleep();
+#endif
+    return;
+  }
+#if NOKIA5110EMU_DMA
+  if ( Nokia5110Emu_Busy() )
+  {
+    LCD_pace_stats.late++;
+    return;
+  }
+#endif
+  {
+    LCD_DEFAULT_BEGIN();
+    LCD_pace_pending = 0;
+    LCD_pace_stats.submitted++;
+    LCD_update_window(LCD_pace_frame);
+    LCD_DEFAULT_END();
+  }
+}
+#endif
+
+#if NOKIA5110EMU_POWER_SAVE
+//============================================================================
+//
+//  Power saving
+//  The emulator only uses black and white, which the ST7735 can still show
+//  in its 8-colour idle mode, and in partial mode only the frame memory lines
+//  of the emulator window are scanned. The frame memory keeps its contents
+//  while the ST7735 sleeps, so after the sleep timeout Timer5A (or the frame
+//  pacing tick) sends SLPIN and the next window opened to draw sends SLPOUT.
+//
+
+//********Nokia5110Emu_SetPowerSave*****************
+// Choose the ST7735 power saving modes and how long it can go
+// without drawing before it is put to sleep. Partial mode blanks
+// the labels and border, idle mode shows PIXEL_BORDER as blue.
+// Frame pacing is not slowed to the idle mode refresh rate.
+// Drawing after the LCD has gone to sleep waits 5ms for it to wake
+// up, or up to 120ms if it has only just gone to sleep.
+// inputs: modes     NOKIA5110EMU_POWER_IDLE and NOKIA5110EMU_POWER_PARTIAL
+//                   or'd together, 0 for normal full colour mode
+//         sleep_ms  milliseconds without drawing before the LCD sleeps,
+//                   0 to never sleep, at least 120
+// outputs: none
+void Nokia5110Emu_SetPowerSave(unsigned char modes, uint32_t sleep_ms)
+{
+  // Start the cycle counter used to time SLPIN to SLPOUT
+  DEMCR_R |= DEMCR_TRCENA;
+  DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+  if ( sleep_ms && sleep_ms < ST7735_SLEEP_MS )
+    sleep_ms = ST7735_SLEEP_MS;
+  if ( sleep_ms > LCD_SLEEP_MAX_MS )
+    sleep_ms = LCD_SLEEP_MAX_MS;
+  LCD_TIMER_LOCK();
+  LCD_power_modes = modes;
+  LCD_power_ms = sleep_ms;
+  // until the LCD is ready the modes are set once it is
+  if ( !LCD_deferred() )
+    LCD_power_apply();
+  LCD_TIMER_UNLOCK();
+}
+
+//============================================================================
+//
+// Send the idle and partial mode settings and start the sleep timeout
+//
+static void LCD_power_apply(void)
+{
+#if NOKIA5110EMU_DMA
+  // the SSI must not be used while pixel data is still being streamed
+  LCD_dma_wait();
+#endif
+  LCD_power_wake();
+  //IDMON (39h): Idle Mode On, IDMOFF (38h): Idle Mode Off
+  SPI_sendCommand(LCD_power_modes & NOKIA5110EMU_POWER_IDLE ? ST7735_IDMON : ST7735_IDMOFF);
+  if ( LCD_power_modes & NOKIA5110EMU_POWER_PARTIAL )
+  {
+    //PTLAR (30h): Partial Area
+    SPI_sendCommand(ST7735_PTLAR);
+    SPI_sendData(LCD_PARTIAL_START >> 8);  //PSL[15:8]
+    SPI_sendData(LCD_PARTIAL_START & 0xFF);//PSL[ 7:0]
+    SPI_sendData(LCD_PARTIAL_END >> 8);    //PEL[15:8]
+    SPI_sendData(LCD_PARTIAL_END & 0xFF);  //PEL[ 7:0]
+    //PTLON (12h): Partial Mode On
+    SPI_sendCommand(ST7735_PTLON);
+  }
+  else
+    //NORON (13h): Normal Display Mode On
+    SPI_sendCommand(ST7735_NORON);
+  LCD_power_touch();
+}
+
+//============================================================================
+//
+// Start the sleep timeout again after drawing
+//
+static void LCD_power_touch(void)
+{
+  if ( !LCD_power_ms )
+    return;
+#if NOKIA5110EMU_ASYNC_INIT
+  // Timer5A is stepping through the bring-up
+  if ( LCD_boot_state != LCD_BOOT_READY )
+    return;
+#endif
+#if NOKIA5110EMU_FRAME_PACING
+  LCD_power_ticks = 0;
+  if ( LCD_pace_running )
+    return;
+#endif
+  TIMER5_CTL_R = 0;
+  TIMER5_TAILR_R = LCD_power_ms*(SYSTEM_CLOCK_HZ/1000) - 1;
+  TIMER5_CTL_R |= TIMER_CTL_TAEN;
+}
+
+//============================================================================
+//
+// Bring the LCD out of sleep mode before drawing
+//
+static void LCD_power_wake(void)
+{
+  if ( !LCD_asleep )
+    return;
+  LCD_asleep = 0;
+  // SLPOUT must be at least 120ms after SLPIN
+  while ( DWT_CYCCNT_R - LCD_asleep_time < ST7735_SLEEP_MS*(SYSTEM_CLOCK_HZ/1000) ) {};
+  //SLPOUT (11h): Sleep Out
+  SPI_sendCommand(ST7735_SLPOUT);
+#if NOKIA5110EMU_TX_QUEUE
+  LCD_txq_wait();
+#endif
+  // the supplies and clocks need 5ms to settle before the next command
+  delay(5);
+}
+
+//============================================================================
+//
+// Put the LCD to sleep when the sleep timeout runs out, called from Timer5A
+//
+static void LCD_power_sleep(void)
+{
+  if ( !LCD_power_ms || LCD_asleep )
+    return;
+#if NOKIA5110EMU_DMA
+  if ( Nokia5110Emu_Busy() )
+  {
+    // try again once uDMA has finished sending the last frame
+    LCD_power_touch();
+    return;
+  }
+#endif
+  //SLPIN (10h): Sleep In
+  // * The DC/DC converter, oscillator and panel scanning stop but the
+  //   MCU interface and frame memory keep working
+  SPI_sendCommand(ST7735_SLPIN);
+#if NOKIA5110EMU_TX_QUEUE
+  LCD_txq_wait();
+#endif
+  LCD_asleep_time = DWT_CYCCNT_R;
+  LCD_asleep = 1;
+}
+#endif
+
+#if NOKIA5110EMU_NATIVE_FRAMES
+//============================================================================
+//
+//  Native frames
+//  Frames made by tools/native_frames.c are already in the LCD's 12-bit
+//  format so they are copied to the SSI2 FIFO without being expanded. With
+//  NOKIA5110EMU_DMA uDMA reads each bank straight from flash, otherwise the
+//  CPU keeps the FIFO topped up. The LCD no longer matches the shadow copy
+//  afterwards, so the next Nokia5110_DisplayBuffer sends a whole frame.
+//  While the LCD is still being initialised a frame is unpacked into the
+//  shadow copy instead, so it is shown once the LCD is ready.
+//
+
+//============================================================================
+//
+// Unpack a native frame into a shadow copy, its pixels are only ever
+// PIXEL_ON or PIXEL_OFF
+//
+static void LCD_unpack_native(char* shadow, const uint8_t* frame)
+{
+  uint16_t row, col;
+  for (row = 0; row < SCREENH; row++)
+  {
+    char *bank = &shadow[row/8*SCREENW];
+    uint8_t bit = 1<<(row%8);
+    if ( row%8 == 0 )
+      for (col = 0; col < SCREENW; col++)
+        bank[col] = 0;
+    for (col = 0; col < SCREENW; col += 2, frame += 3)
+    {
+      if ( ((frame[0]<<4)|(frame[1]>>4)) == PIXEL_ON )
+        bank[col] |= bit;
+      if ( (((frame[1]&0x0F)<<8)|frame[2]) == PIXEL_ON )
+        bank[col+1] |= bit;
+    }
+  }
+}
+
+//********Nokia5110Emu_DrawNative*****************
+// Fill the whole screen with one frame from an array of native
+// frames and reset the text cursor to (0,0).
+// With NOKIA5110EMU_DMA the frame is still being sent when this
+// returns so it must not change until Nokia5110Emu_Busy is 0.
+// inputs: frames  NOKIA5110EMU_NATIVE_BYTES bytes for each frame
+//         index   frame to draw, 0 for the first
+// outputs: none
+void Nokia5110Emu_DrawNative(const uint8_t *frames, unsigned short index)
+{
+  const uint8_t *frame = &frames[(uint32_t)index*NOKIA5110EMU_NATIVE_BYTES];
+#if NOKIA5110EMU_DMA
+  uint16_t i;
+#endif
+  LCD_TIMER_LOCK();
+  if ( LCD_deferred() )
+  {
+    LCD_DEFAULT_BEGIN();
+    LCD_ctx->cursor_x = 0;
+    LCD_ctx->cursor_y = 0;
+    LCD_unpack_native(LCD_ctx->shadow, frame);
+    LCD_ctx->shadow_valid = 1;
+    LCD_MIRROR_CHANGED();
+    LCD_DEFAULT_END();
+  }
+  else
+  {
+    LCD_DEFAULT_BEGIN();
+    LCD_STAT(frames, 1);
+#if NOKIA5110EMU_SCROLL
+    if ( LCD_scroll_y )
+      LCD_scroll_to(0);
+#endif
+    LCD_reset_window();
+#if NOKIA5110EMU_DMA
+    // one region per bank sent from flash, only the first opens the window
+    LCD_dma_count = 0;
+    for (i = 0; i < SCREENH/8; i++)
+    {
+      LCD_dma_add(i, 0, SCREENW-1, 0, 0);
+      LCD_dma_region[LCD_dma_count-1].packed = &frame[i*SCREENW*8*3/2];
+      LCD_dma_region[LCD_dma_count-1].rows = i ? 0 : SCREENH;
+    }
+    LCD_dma_kick();
+#else
+    LCD_send_packed(frame, NOKIA5110EMU_NATIVE_BYTES);
+#endif
+    LCD_ctx->shadow_valid = 0;
+    LCD_DEFAULT_END();
+  }
+  LCD_TIMER_UNLOCK();
+}
+
+//********Nokia5110Emu_PlayNative*****************
+// Draw count native frames one after another starting at frame
+// first, one every 1/hz seconds timed by the cycle counter. A
+// frame which takes longer than that to send delays the rest.
+// inputs: frames  NOKIA5110EMU_NATIVE_BYTES bytes for each frame
+//         first   first frame to draw
+//         count   number of frames to draw
+//         hz      frames per second, 0 for as fast as they can be sent
+// outputs: none
+void Nokia5110Emu_PlayNative(const uint8_t *frames, unsigned short first, unsigned short count, unsigned long hz)
+{
+  uint32_t period = hz ? SYSTEM_CLOCK_HZ/hz : 0;
+  uint32_t next;
+  // Start the cycle counter used to time the frames
+  DEMCR_R |= DEMCR_TRCENA;
+  DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+  next = DWT_CYCCNT_R;
+  while ( count-- )
+  {
+    Nokia5110Emu_DrawNative(frames, first++);
+    next += period;
+    while ( (int32_t)(DWT_CYCCNT_R - next) < 0 ) {};
+  }
+}
+#endif
+
+// Run tokens of delta frames and mirror packets
+#define LCD_DELTA_COPY  0x80
+#define LCD_DELTA_FILL  0xC0
+#define LCD_DELTA_SKIP_M 0x7F
+#define LCD_DELTA_RUN_M  0x3F
+
+#if NOKIA5110EMU_DELTA_FRAMES
+//============================================================================
+//
+//  Delta frames
+//  Each frame of an animation made by tools/delta_frames.c is a list of
+//  runs covering the 504 Screen bytes in order, each run starting with a
+//  token byte:
+//    0x00-0x7F  skip token+1 bytes which are the same as the last frame
+//    0x80-0xBF  XOR the next (token&0x3F)+1 bytes into the Screen buffer
+//    0xC0-0xFF  XOR the next byte into (token&0x3F)+1 Screen bytes
+//  The first frame is XORed with a cleared buffer. Frames are decoded into
+//  Screen so Nokia5110_DisplayBuffer only sends the bytes that changed.
+//
+
+//********Nokia5110Emu_DecodeDelta*****************
+// Apply one frame of a delta animation to the Screen buffer.
+// Call Nokia5110_ClearBuffer before decoding the first frame.
+// inputs: frame  first token of the frame
+// outputs: first token of the next frame
+const uint8_t *Nokia5110Emu_DecodeDelta(const uint8_t *frame)
+{
+  uint16_t i = 0;
+  while ( i < SCREENW*SCREENH/8 )
+  {
+    uint8_t token = *frame++;
+    uint16_t count = (token < LCD_DELTA_COPY ? (token & LCD_DELTA_SKIP_M) : (token & LCD_DELTA_RUN_M)) + 1;
+    // never run off the end of Screen on a bad frame
+    if ( count > SCREENW*SCREENH/8 - i )
+      count = SCREENW*SCREENH/8 - i;
+    if ( token >= LCD_DELTA_FILL )
+    {
+      uint8_t bits = *frame++;
+      while ( count-- )
+        Screen[i++] ^= bits;
+    }
+    else if ( token >= LCD_DELTA_COPY )
+    {
+      while ( count-- )
+        Screen[i++] ^= *frame++;
+    }
+    else
+      i += count;
+  }
+  return frame;
+}
+
+//********Nokia5110Emu_DrawDelta*****************
+// Apply one frame of a delta animation to the Screen buffer
+// and send the bytes which changed to the LCD.
+// inputs: frame  first token of the frame
+// outputs: first token of the next frame
+const uint8_t *Nokia5110Emu_DrawDelta(const uint8_t *frame)
+{
+  frame = Nokia5110Emu_DecodeDelta(frame);
+  Nokia5110_DisplayBuffer();
+  return frame;
+}
+#endif
+
+#if NOKIA5110EMU_PCD8544
+//============================================================================
+//
+//  PCD8544 emulation
+//  Data bytes are written straight into the shadow copy at the address
+//  counter, which moves on the same way as the PCD8544's. The span of
+//  columns written to each bank is remembered and sent in one window per
+//  bank when the next command arrives or Nokia5110Emu_PCD8544Flush is
+//  called. The display control and H = 1 commands (contrast, bias and
+//  temperature) have nothing to do on the ST7735 and are ignored.
+//
+
+//********Nokia5110Emu_PCD8544Write*****************
+// Handle one byte sent to the PCD8544, the same as lcdwrite in the
+// original Nokia5110.c. A command first sends any data written
+// since the last command.
+// inputs: data  0 for a command (D/C low), 1 for display data (D/C high)
+//         byte  command or 8 rows of pixels, bit 0 at the top
+// outputs: none
+void Nokia5110Emu_PCD8544Write(int data, unsigned char byte)
+{
+  uint8_t bank;
+  if ( !data )
+  {
+    if ( LCD_pcd_dirty )
+      Nokia5110Emu_PCD8544Flush();
+    if ( (byte & 0xF8) == PCD8544_FUNCTION )
+      LCD_pcd_function = byte;
+    else if ( !(LCD_pcd_function & PCD8544_FUNCTION_H) )
+    {
+      if ( byte & PCD8544_SET_X )
+      {
+        if ( (byte & 0x7F) < SCREENW )
+          LCD_pcd_x = byte & 0x7F;
+      }
+      else if ( (byte & 0xF8) == PCD8544_SET_Y && (byte & 0x07) < SCREENH/8 )
+        LCD_pcd_y = byte & 0x07;
+    }
+    return;
+  }
+  bank = LCD_STORED_BANK(LCD_pcd_y);
+#if NOKIA5110EMU_DMA
+  // the shadow copy is the source of the transfer so it must not be changed
+  LCD_dma_wait();
+#endif
+  LCD_context[0].shadow[bank*SCREENW + LCD_pcd_x] = byte;
+  if ( LCD_pcd_end[bank] == 0 )
+  {
+    // first column written to this bank
+    LCD_pcd_first[bank] = LCD_pcd_x;
+    LCD_pcd_end[bank] = LCD_pcd_x + 1;
+  }
+  else if ( LCD_pcd_x < LCD_pcd_first[bank] )
+    LCD_pcd_first[bank] = LCD_pcd_x;
+  else if ( LCD_pcd_x >= LCD_pcd_end[bank] )
+    LCD_pcd_end[bank] = LCD_pcd_x + 1;
+  LCD_pcd_dirty = 1;
+  // move the address counter on, wrapping from the last column or bank
+  if ( LCD_pcd_function & PCD8544_FUNCTION_V )
+  {
+    if ( ++LCD_pcd_y == SCREENH/8 )
+    {
+      LCD_pcd_y = 0;
+      if ( ++LCD_pcd_x == SCREENW )
+        LCD_pcd_x = 0;
+    }
+  }
+  else if ( ++LCD_pcd_x == SCREENW )
+  {
+    LCD_pcd_x = 0;
+    if ( ++LCD_pcd_y == SCREENH/8 )
+      LCD_pcd_y = 0;
+  }
+}
+
+//********Nokia5110Emu_PCD8544Flush*****************
+// Send everything written by Nokia5110Emu_PCD8544Write since the
+// last flush to the LCD, one window per bank covering the columns
+// which were written. Call at the end of a transaction which does
+// not end with a command.
+// inputs: none
+// outputs: none
+void Nokia5110Emu_PCD8544Flush(void)
+{
+  uint16_t bank;
+  LCD_TIMER_LOCK();
+  if ( !LCD_deferred() )
+  {
+    LCD_DEFAULT_BEGIN();
+#if NOKIA5110EMU_DMA
+    LCD_dma_wait();
+    LCD_dma_count = 0;
+#endif
+    for (bank = 0; bank < SCREENH/8; bank++)
+      if ( LCD_pcd_end[bank] )
+        // window width must be even so align the span to pixel pairs
+        LCD_send_span(bank, LCD_pcd_first[bank] & ~(LCD_SCALE_IN-1),
+                      (LCD_pcd_end[bank] - 1) | (LCD_SCALE_IN-1));
+#if NOKIA5110EMU_DMA
+    LCD_dma_kick();
+#endif
+    LCD_DEFAULT_END();
+  }
+  // when the LCD is not ready the whole shadow copy is sent once it is
+  for (bank = 0; bank < SCREENH/8; bank++)
+    LCD_pcd_end[bank] = 0;
+  LCD_pcd_dirty = 0;
+  LCD_MIRROR_KICK();
+  LCD_TIMER_UNLOCK();
+}
+#endif
+
+#if NOKIA5110EMU_SERVER
+//============================================================================
+//
+//  Display server
+//  Nokia5110Emu_ServerThread should be the only thread which calls the
+//  drawing functions, every other thread posts requests to it instead. The
+//  Post functions never wait for the LCD and return 0 if the request queue
+//  is full so the request was dropped, 1 if it was queued.
+//
+
+//============================================================================
+//
+// Reserve the next request slot, returns 0 if there are none free
+//
+static struct LCD_request* LCD_server_reserve(uint8_t type)
+{
+  struct LCD_request *slot = 0;
+  long sr = StartCritical();
+  uint16_t head = LCD_server_head;
+  if ( (uint16_t)(head - LCD_server_tail) < NOKIA5110EMU_SERVER_SLOTS )
+  {
+    slot = &LCD_server_slot[head&(NOKIA5110EMU_SERVER_SLOTS-1)];
+    LCD_server_head = head + 1;
+  }
+  EndCritical(sr);
+  if ( slot )
+    slot->type = type;
+  return slot;
+}
+
+//********Nokia5110Emu_PostString*****************
+// Ask the display server to print a string with the cursor at (x,y)
+// inputs: x    new X-position of the cursor (0<=x<=13)
+//         y    new Y-position of the cursor (0<=y<=5)
+//         ptr  pointer to NULL-terminated ASCII string, only the first
+//              15 characters are used
+// outputs: 1 if the request was queued, 0 if it was dropped
+int Nokia5110Emu_PostString(unsigned char x, unsigned char y, const char *ptr)
+{
+  int i;
+  struct LCD_request *slot = LCD_server_reserve(LCD_REQ_STRING);
+  if ( !slot )
+    return 0;
+  slot->x = x;
+  slot->y = y;
+  for (i = 0; i < LCD_REQ_TEXT-1 && ptr[i]; i++)
+    slot->text[i] = ptr[i];
+  slot->text[i] = 0;
+  slot->ready = 1;
+  return 1;
+}
+
+//********Nokia5110Emu_PostUDec*****************
+// Ask the display server to print a 16-bit number in unsigned decimal
+// format as five right-justified digits with the cursor at (x,y)
+// inputs: x  new X-position of the cursor (0<=x<=13)
+//         y  new Y-position of the cursor (0<=y<=5)
+//         n  16-bit unsigned number
+// outputs: 1 if the request was queued, 0 if it was dropped
+int Nokia5110Emu_PostUDec(unsigned char x, unsigned char y, unsigned short n)
+{
+  char digits[6];
+  LCD_udec_string(digits, n);
+  return Nokia5110Emu_PostString(x, y, digits);
+}
+
+//********Nokia5110Emu_PostClear*****************
+// Ask the display server to clear the emulator window
+// inputs: none
+// outputs: 1 if the request was queued, 0 if it was dropped
+int Nokia5110Emu_PostClear(void)
+{
+  struct LCD_request *slot = LCD_server_reserve(LCD_REQ_CLEAR);
+  if ( !slot )
+    return 0;
+  slot->ready = 1;
+  return 1;
+}
+
+//********Nokia5110Emu_PostFrame*****************
+// Ask the display server to show a 84x48 screen image. The image is
+// copied so frame can be reused straight away. If the server has not
+// got round to an earlier frame, only the latest one is shown.
+// inputs: frame  pointer to 504 byte screen image
+// outputs: 1 if the request was queued, 0 if it was dropped
+int Nokia5110Emu_PostFrame(const char *frame)
+{
+  int i;
+  long sr;
+  struct LCD_request *slot = LCD_server_reserve(LCD_REQ_FRAME);
+  if ( !slot )
+    return 0;
+  sr = StartCritical();   // the server copies the frame inside one too
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+    LCD_server_frame[i] = frame[i];
+  EndCritical(sr);
+  slot->ready = 1;
+  return 1;
+}
+
+//********Nokia5110Emu_Serve*****************
+// Carry out every request which has been posted so far, in order,
+// stopping at one which is still being filled in. Only the display
+// server thread may call this.
+// inputs: none
+// outputs: number of requests carried out
+int Nokia5110Emu_Serve(void)
+{
+  int i, count = 0;
+  long sr;
+  LCD_DEFAULT_BEGIN();
+  for (;;)
+  {
+    struct LCD_request *slot = &LCD_server_slot[LCD_server_tail&(NOKIA5110EMU_SERVER_SLOTS-1)];
+    if ( LCD_server_tail == LCD_server_head || !slot->ready )
+    {
+      LCD_DEFAULT_END();
+      return count;
+    }
+    switch ( slot->type )
+    {
+      case LCD_REQ_STRING:
+        Nokia5110Emu_SetCursor(slot->x, slot->y);
+        Nokia5110Emu_OutString((unsigned char *)slot->text);
+        break;
+      case LCD_REQ_CLEAR:
+        Nokia5110Emu_Clear();
+        break;
+      case LCD_REQ_FRAME:
+        sr = StartCritical();
+        for (i = 0; i < SCREENW*SCREENH/8; i++)
+          LCD_server_back[i] = LCD_server_frame[i];
+        EndCritical(sr);
+        if ( LCD_ctx->shadow_valid )
+        {
+          LCD_TIMER_LOCK();
+          LCD_update_window(LCD_server_back);
+          LCD_TIMER_UNLOCK();
+        }
+        else
+          Nokia5110Emu_DrawFullImage(LCD_server_back);
+        break;
+    }
+    slot->ready = 0;
+    LCD_server_tail = LCD_server_tail + 1; // hand the slot back
+    count++;
+  }
+}
+
+//********Nokia5110Emu_ServerThread*****************
+// Display server thread, add it to the RTOS at a low priority after
+// Nokia5110_Init has been called. It owns SSI2 and the LCD and draws
+// the posted requests, giving up the processor when there are none.
+// inputs: none
+// outputs: none
+void Nokia5110Emu_ServerThread(void)
+{
+  for (;;)
+  {
+    if ( Nokia5110Emu_Serve() == 0 )
+      NOKIA5110EMU_SERVER_IDLE();
+  }
+}
+#endif
+
+#if NOKIA5110EMU_STATS
+//********Nokia5110Emu_GetStats*****************
+// Copy the statistics counters gathered since the last reset
+// inputs: stats  where to store the counters
+// outputs: none
+void Nokia5110Emu_GetStats(struct Nokia5110Emu_Stats *stats)
+{
+  *stats = LCD_stats;
 }
 
-//********Nokia5110_OutUDec*****************
-// Output a 16-bit number in unsigned decimal format with a
-// fixed size of five right-justified digits of output.
-// Inputs: n  16-bit unsigned number
-// Outputs: none
-void Nokia5110_OutUDec(unsigned short n)
+//********Nokia5110Emu_ResetStats*****************
+// Set all the statistics counters back to zero
+// inputs: none
+// outputs: none
+void Nokia5110Emu_ResetStats(void)
+{
+  struct Nokia5110Emu_Stats zero = {0};
+  LCD_stats = zero;
+}
+
+//********Nokia5110Emu_DrawStats*****************
+// Show the frames per second and SPI bytes per frame since the
+// last call in the border below the emulator window.
+// inputs: none
+// outputs: none
+void Nokia5110Emu_DrawStats(void)
+{
+  char text[] = "FPS      B/F      ";
+  uint32_t now = DWT_CYCCNT_R;
+  uint32_t frames = LCD_stats.frames - LCD_stats_last.frames;
+  uint32_t bytes = LCD_stats.command_bytes - LCD_stats_last.command_bytes
+                 + LCD_stats.pixel_bytes - LCD_stats_last.pixel_bytes;
+  uint32_t fps = (uint64_t)frames*SYSTEM_CLOCK_HZ/(now - LCD_stats_time);
+  if ( frames )
+    bytes = bytes/frames;
+  LCD_udec_string(&text[3], fps > 65535 ? 65535 : fps);
+  text[8] = ' ';
+  LCD_udec_string(&text[12], bytes > 65535 ? 65535 : bytes);
+  LCD_draw_label((ST7735_MAX_X-17*CHAR_WIDTH)/2,       // Centre 17 chars
+                 NOKIA_WINDOW_Y+LCD_VIEW_H+CHAR_HEIGHT, text); // 1 row below emulator window
+  // the overlay itself is not counted in the next result
+  LCD_stats_time = DWT_CYCCNT_R;
+  LCD_stats_last = LCD_stats;
+}
+#endif
+
+#if NOKIA5110EMU_TRACE
+//============================================================================
+//
+//  SPI trace
+//  Every command, window and run of pixel data is logged as it is sent, or
+//  queued with NOKIA5110EMU_TX_QUEUE or NOKIA5110EMU_DMA, in a ring buffer of
+//  the last NOKIA5110EMU_TRACE_SIZE transactions. Nokia5110Emu_TraceDump sends
+//  it over UART0 as a 16 byte header followed by 16 bytes for each one, all
+//  values little endian:
+//    header  "ST7T", version 1, entry size 16, uint16 entries in the dump,
+//            uint32 transactions since cleared, uint32 SYSTEM_CLOCK_HZ
+//    entry   uint32 time, uint32 wait cycles, uint16 bytes, uint8 type, code,
+//            x, y, width and height
+//  tools/spi_trace.c turns a capture into a listing and totals.
+//
+
+//============================================================================
+//
+// Add one transaction for the last window set to the trace
+//
+static void LCD_trace_add(uint8_t type, uint8_t code, uint16_t bytes)
+{
+  struct LCD_trace_entry *e;
+  if ( LCD_trace_paused )
+    return;
+  e = &LCD_trace[LCD_trace_next++ & (NOKIA5110EMU_TRACE_SIZE - 1)];
+  e->time = DWT_CYCCNT_R;
+  e->wait = 0;
+  e->bytes = bytes;
+  e->type = type;
+  e->code = code;
+  e->x = LCD_trace_window[0];
+  e->y = LCD_trace_window[1];
+  e->width = LCD_trace_window[2];
+  e->height = LCD_trace_window[3];
+}
+
+//============================================================================
+//
+// Trace a command byte, or a parameter byte as part of the command before it.
+// CASET, RASET, RAMWR and their parameters are already traced as one window
+// by LCD_set_window
+//
+static void LCD_trace_command(uint8_t byte, uint8_t command)
 {
-  if(n < 10){
-    Nokia5110_OutString("    ");
-    Nokia5110_OutChar(n+'0'); /* n is between 0 and 9 */
-  } else if(n<100){
-    Nokia5110_OutString("   ");
-    Nokia5110_OutChar(n/10+'0'); /* tens digit */
-    Nokia5110_OutChar(n%10+'0'); /* ones digit */
-  } else if(n<1000){
-    Nokia5110_OutString("  ");
-    Nokia5110_OutChar(n/100+'0'); /* hundreds digit */
-    n = n%100;
-    Nokia5110_OutChar(n/10+'0'); /* tens digit */
-    Nokia5110_OutChar(n%10+'0'); /* ones digit */
-  }
-  else if(n<10000){
-    Nokia5110_OutChar(' ');
-    Nokia5110_OutChar(n/1000+'0'); /* thousands digit */
-    n = n%1000;
-    Nokia5110_OutChar(n/100+'0'); /* hundreds digit */
-    n = n%100;
-    Nokia5110_OutChar(n/10+'0'); /* tens digit */
-    Nokia5110_OutChar(n%10+'0'); /* ones digit */
-  }
-  else {
-    Nokia5110_OutChar(n/10000+'0'); /* ten-thousands digit */
-    n = n%10000;
-    Nokia5110_OutChar(n/1000+'0'); /* thousands digit */
-    n = n%1000;
-    Nokia5110_OutChar(n/100+'0'); /* hundreds digit */
-    n = n%100;
-    Nokia5110_OutChar(n/10+'0'); /* tens digit */
-    Nokia5110_OutChar(n%10+'0'); /* ones digit */
+  struct LCD_trace_entry *last = &LCD_trace[(LCD_trace_next - 1) & (NOKIA5110EMU_TRACE_SIZE - 1)];
+  if ( command )
+  {
+    if ( byte != ST7735_CASET && byte != ST7735_RASET && byte != ST7735_RAMWR )
+      LCD_trace_add(LCD_TRACE_COMMAND, byte, 1);
   }
+  else if ( LCD_trace_next && !LCD_trace_paused && last->type == LCD_TRACE_COMMAND )
+    last->bytes++;
 }
 
-//********Nokia5110_SetCursor*****************
-// Wrapper to new emulator function
-void Nokia5110_SetCursor(unsigned char newX, unsigned char newY)
+//============================================================================
+//
+// Send the low bytes of value over UART0, least significant first
+//
+static void LCD_trace_send(uint32_t value, uint8_t bytes)
 {
-  Nokia5110Emu_SetCursor(newX, newY);
+  while ( bytes-- )
+  {
+    while ( UART0_FR_R & UART_FR_TXFF ) {};
+    UART0_DR_R = value & 0xFF;
+    value >>= 8;
+  }
 }
 
-//********Nokia5110_Clear*****************
-// Clear the LCD by writing zeros to the entire screen and
-// reset the cursor to (0,0) (top left corner of screen).
-// inputs: none
+//********Nokia5110Emu_TraceMark*****************
+// Add a marker to the SPI trace, so the transactions sent by
+// each part of a program can be told apart.
+// inputs: tag  any value to identify the marker by
 // outputs: none
-void Nokia5110_Clear(void)
+void Nokia5110Emu_TraceMark(unsigned char tag)
 {
-  Nokia5110Emu_Clear();
+  LCD_trace_add(LCD_TRACE_MARK, tag, 0);
 }
 
-//********Nokia5110_DrawFullImage*****************
-// Fill the whole screen by drawing a 48x84 bitmap image.
-// inputs: ptr  pointer to 504 byte bitmap
+//********Nokia5110Emu_TraceClear*****************
+// Empty the SPI trace.
+// inputs: none
 // outputs: none
-// assumes: LCD is in default horizontal addressing mode (V = 0)
-void Nokia5110_DrawFullImage(const char *ptr)
+void Nokia5110Emu_TraceClear(void)
 {
-  Nokia5110_SetCursor(0, 0);
-  Nokia5110Emu_DrawFullImage(ptr);
+  LCD_trace_next = 0;
 }
 
-//********Nokia5110_PrintBMP*****************
-// Bitmaps defined above were created for the LM3S1968 or
-// LM3S8962's 4-bit grayscale OLED display.  They also
-// still contain their header data and may contain padding
-// to preserve 4-byte alignment.  This function takes a
-// bitmap in the previously described format and puts its
-// image data in the proper location in the buffer so the
-// image will appear on the screen after the next call to
-//   Nokia5110_DisplayBuffer();
-// The interface and operation of this process is modeled
-// after RIT128x96x4_BMP(x, y, image);
-// inputs: xpos      horizontal position of bottom left corner of image, columns from the left edge
-//                     must be less than 84
-//                     0 is on the left; 82 is near the right
-//         ypos      vertical position of bottom left corner of image, rows from the top edge
-//                     must be less than 48
-//                     2 is near the top; 47 is at the bottom
-//         ptr       pointer to a 16 color BMP image
-//         threshold grayscale colors above this number make corresponding pixel 'on'
-//                     0 to 14
-//                     0 is fine for ships, explosions, projectiles, and bunkers
+//********Nokia5110Emu_TraceDump*****************
+// Send the SPI trace over UART0, oldest transaction first. The
+// trace is left as it is, nothing is added while it is sent.
+// UART0 is set up at NOKIA5110EMU_TRACE_BAUD unless it is
+// already enabled.
+// inputs: none
 // outputs: none
-void Nokia5110_PrintBMP(unsigned char xpos, unsigned char ypos, const unsigned char *ptr, unsigned char threshold)
+void Nokia5110Emu_TraceDump(void)
 {
-  long width = ptr[18], height = ptr[22], i, j;
-  unsigned short screenx, screeny;
-  unsigned char mask;
-  // check for clipping
-  if((height <= 0) ||              // bitmap is unexpectedly encoded in top-to-bottom pixel order
-     ((width%2) != 0) ||           // must be even number of columns
-     ((xpos + width) > SCREENW) || // right side cut off
-     (ypos < (height - 1)) ||      // top cut off
-     (ypos > SCREENH))           { // bottom cut off
-    return;
+  uint32_t next, count, i;
+  LCD_trace_paused = 1;
+  if ( !(SYSCTL_PRUART_R & SYSCTL_PRUART_R0) || !(UART0_CTL_R & UART_CTL_UARTEN) )
+    Initialize_UART0();
+  next = LCD_trace_next;
+  count = next < NOKIA5110EMU_TRACE_SIZE ? next : NOKIA5110EMU_TRACE_SIZE;
+  LCD_trace_send('S' | 'T' << 8 | '7' << 16 | (uint32_t)'T' << 24, 4);
+  LCD_trace_send(1, 1);
+  LCD_trace_send(sizeof(struct LCD_trace_entry), 1);
+  LCD_trace_send(count, 2);
+  LCD_trace_send(next, 4);
+  LCD_trace_send(SYSTEM_CLOCK_HZ, 4);
+  for (i = next - count; i != next; i++)
+  {
+    const struct LCD_trace_entry *e = &LCD_trace[i & (NOKIA5110EMU_TRACE_SIZE - 1)];
+    LCD_trace_send(e->time, 4);
+    LCD_trace_send(e->wait, 4);
+    LCD_trace_send(e->bytes, 2);
+    LCD_trace_send(e->type, 1);
+    LCD_trace_send(e->code, 1);
+    LCD_trace_send(e->x, 1);
+    LCD_trace_send(e->y, 1);
+    LCD_trace_send(e->width, 1);
+    LCD_trace_send(e->height, 1);
   }
-  if(threshold > 14){
-    threshold = 14;             // only full 'on' turns pixel on
+  // Wait for the last byte to be sent
+  while ( UART0_FR_R & UART_FR_BUSY ) {};
+  LCD_trace_paused = 0;
+}
+#endif
+
+#if NOKIA5110EMU_TRACE || NOKIA5110EMU_MIRROR
+#if NOKIA5110EMU_MIRROR
+  #define LCD_UART0_BAUD NOKIA5110EMU_MIRROR_BAUD
+#else
+  #define LCD_UART0_BAUD NOKIA5110EMU_TRACE_BAUD
+#endif
+//============================================================================
+//
+//  Initialise UART0 on PA0/PA1 for 8 data bits, no parity, one stop bit at
+//  NOKIA5110EMU_MIRROR_BAUD for the mirror or NOKIA5110EMU_TRACE_BAUD
+//
+void Initialize_UART0(void)
+{
+	volatile unsigned long temp;
+	// baud rate divisor in 64ths, SysClk/(16*baud) rounded to the nearest
+	uint32_t divisor = (SYSTEM_CLOCK_HZ*8UL/LCD_UART0_BAUD + 1)/2;
+	SYSCTL_RCGCUART_R |= SYSCTL_RCGCUART_R0;  // Enable UART0 Clock
+	SYSCTL_RCGCGPIO_R |= SYSCTL_RCGCGPIO_R0;  // Enable Port A Clock
+	temp = SYSCTL_RCGCGPIO_R;
+	while ( !(SYSCTL_PRUART_R & SYSCTL_PRUART_R0) ) {}; // wait for UART0 to be ready
+	UART0_CTL_R &= ~UART_CTL_UARTEN;          // disable UART0 during setup
+	UART0_IBRD_R = divisor/64;
+	UART0_FBRD_R = divisor%64;
+	UART0_LCRH_R = UART_LCRH_WLEN_8|UART_LCRH_FEN; // 8N1 with FIFOs
+	UART0_CC_R = (UART0_CC_R&~UART_CC_CS_M)+UART_CC_CS_SYSCLK;
+	UART0_CTL_R |= UART_CTL_UARTEN|UART_CTL_TXE|UART_CTL_RXE;
+	GPIO_PORTA_AFSEL_R |= 0x03;               // PA0 U0Rx and PA1 U0Tx
+	GPIO_PORTA_PCTL_R = (GPIO_PORTA_PCTL_R&~(GPIO_PCTL_PA0_M|GPIO_PCTL_PA1_M))
+	                  | GPIO_PCTL_PA0_U0RX|GPIO_PCTL_PA1_U0TX;
+	GPIO_PORTA_DEN_R |= 0x03;
+	GPIO_PORTA_AMSEL_R &= ~0x03;
+}
+#endif
+
+#if NOKIA5110EMU_MIRROR
+//============================================================================
+//
+//  UART0 mirror
+//  The emulator window is streamed to tools/mirror_view.c as it changes. A
+//  copy of what the viewer shows is kept, and each packet holds the XOR of
+//  display 0's shadow copy with it coded as the runs of a delta frame, less
+//  the last run of unchanged bytes. LCD_find_span finds the changed columns
+//  of each bank, so unchanged banks and columns cost a skip token at most.
+//  Each packet is:
+//    0xA5, type 'K' for a key frame XORed with a cleared screen or 'D' for a
+//    delta, uint8 sequence number, uint16 length of the runs little endian,
+//    the runs, and a checksum making the sum of every byte after 0xA5 zero
+//  UART0_Handler only encodes a packet once the last one is in the FIFO, so
+//  the UART sets the rate and changes made while it is busy are merged into
+//  the next packet. Drawing only flags the change and pends the interrupt.
+//  A viewer which starts late or loses a packet sends any byte to get a key
+//  frame.
+//
+
+//============================================================================
+//
+// Initialise UART0 for the mirror with its interrupt at the lowest priority,
+// the first packet is a key frame
+//
+void Initialize_Mirror(void)
+{
+	Initialize_UART0();
+	UART0_IFLS_R = UART_IFLS_TX1_8|UART_IFLS_RX1_8; // refill with 2 bytes left
+	UART0_ICR_R = UART_ICR_TXIC|UART_ICR_RXIC|UART_ICR_RTIC;
+	UART0_IM_R = UART_IM_TXIM|UART_IM_RXIM|UART_IM_RTIM;
+	NVIC_PRI1_R = (NVIC_PRI1_R&0xFFFF00FF)|0x0000E000; // priority 7
+	NVIC_EN0_R = LCD_MIRROR_INT_B;          // enable UART0 interrupt in NVIC
+	LCD_mirror_key = 1;
+	LCD_MIRROR_KICK();
+}
+
+//============================================================================
+//
+// Number of bytes from column i to last of a bank, up to a whole run, which
+// differ from the viewer's copy in the same bits as column i
+//
+static uint16_t LCD_mirror_same(const char* new_bank, const char* old_bank, uint16_t i, uint16_t last)
+{
+  uint8_t d = new_bank[i] ^ old_bank[i];
+  uint16_t n = 1;
+  while ( i + n <= last && n <= LCD_DELTA_RUN_M && (uint8_t)(new_bank[i+n] ^ old_bank[i+n]) == d )
+    n++;
+  return n;
+}
+
+//============================================================================
+//
+// Write skip tokens for count unchanged bytes
+//
+static uint8_t *LCD_mirror_skip(uint8_t *p, uint16_t count)
+{
+  for (; count > LCD_DELTA_SKIP_M + 1; count -= LCD_DELTA_SKIP_M + 1)
+    *p++ = LCD_DELTA_SKIP_M;
+  if ( count )
+    *p++ = count - 1;
+  return p;
+}
+
+//============================================================================
+//
+// Encode the changes to display 0 since the last packet into the packet
+// buffer and update the viewer's copy to match. The values read are the ones
+// sent, so anything drawn while this runs is picked up by the next packet.
+// Returns the length of the packet, 0 if nothing changed
+//
+static uint16_t LCD_mirror_encode(void)
+{
+  uint8_t *p = &LCD_mirror_packet[LCD_MIRROR_HEADER];
+  uint16_t bank, first, last, i, j, n, length, skip = 0;
+  uint8_t type = 'D', sum, d;
+  if ( LCD_mirror_key )
+  {
+    LCD_mirror_key = 0;
+    type = 'K';
+    for (i = 0; i < SCREENW*SCREENH/8; i++)
+      LCD_mirror_copy[i] = 0;
   }
-  // bitmaps are encoded backwards, so start at the bottom left corner of the image
-  screeny = ypos/8;
-  screenx = xpos + SCREENW*screeny;
-  mask = ypos%8;                // row 0 to 7
-  mask = 0x01<<mask;            // now stores a mask 0x01 to 0x80
-  j = ptr[10];                  // byte 10 contains the offset where image data can be found
-  for(i=1; i<=(width*height/2); i=i+1){
-    // the left pixel is in the upper 4 bits
-    if(((ptr[j]>>4)&0xF) > threshold){
-      Screen[screenx] |= mask;
-    } else{
-      Screen[screenx] &= ~mask;
-    }
-    screenx = screenx + 1;
-    // the right pixel is in the lower 4 bits
-    if((ptr[j]&0xF) > threshold){
-      Screen[screenx] |= mask;
-    } else{
-      Screen[screenx] &= ~mask;
+  for (bank = 0; bank < SCREENH/8; bank++)
+  {
+    const char *new_bank = &LCD_context[0].shadow[LCD_STORED_BANK(bank)*SCREENW];
+    char *old_bank = &LCD_mirror_copy[bank*SCREENW];
+    if ( !LCD_find_span(new_bank, old_bank, &first, &last) )
+    {
+      skip += SCREENW;
+      continue;
     }
-    screenx = screenx + 1;
-    j = j + 1;
-    if((i%(width/2)) == 0){     // at the end of a row
-      if(mask > 0x01){
-        mask = mask>>1;
-      } else{
-        mask = 0x80;
-        screeny = screeny - 1;
+    skip += first;
+    for (i = first; i <= last; i += n)
+    {
+      d = new_bank[i] ^ old_bank[i];
+      n = 1;
+      if ( d == 0 )
+      {
+        skip++;
+        continue;
       }
-      screenx = xpos + SCREENW*screeny;
-      // bitmaps are 32-bit word aligned
-      switch((width/2)%4){      // skip any padding
-        case 0: j = j + 0; break;
-        case 1: j = j + 3; break;
-        case 2: j = j + 2; break;
-        case 3: j = j + 1; break;
+      p = LCD_mirror_skip(p, skip);
+      skip = 0;
+      n = LCD_mirror_same(new_bank, old_bank, i, last);
+      if ( n >= LCD_MIRROR_FILL_MIN )
+      {
+        *p++ = LCD_DELTA_FILL | (n - 1);
+        *p++ = d;
+        for (j = i; j < i + n; j++)
+          old_bank[j] ^= d;
+        continue;
+      }
+      // literal bytes up to the next unchanged byte or worthwhile repeat
+      for (n = 1; i + n <= last && n <= LCD_DELTA_RUN_M && (new_bank[i+n] ^ old_bank[i+n]) &&
+           LCD_mirror_same(new_bank, old_bank, i + n, last) < LCD_MIRROR_FILL_MIN; n++) {};
+      *p++ = LCD_DELTA_COPY | (n - 1);
+      for (j = i; j < i + n; j++)
+      {
+        d = new_bank[j] ^ old_bank[j];
+        *p++ = d;
+        old_bank[j] ^= d;
       }
     }
+    skip += SCREENW - 1 - last;
   }
+  length = p - &LCD_mirror_packet[LCD_MIRROR_HEADER];
+  if ( length == 0 && type == 'D' )
+    return 0;
+  LCD_mirror_packet[0] = 0xA5;
+  LCD_mirror_packet[1] = type;
+  LCD_mirror_packet[2] = LCD_mirror_sequence++;
+  LCD_mirror_packet[3] = length & 0xFF;
+  LCD_mirror_packet[4] = length >> 8;
+  for (i = 1, sum = 0; i < LCD_MIRROR_HEADER + length; i++)
+    sum += LCD_mirror_packet[i];
+  LCD_mirror_packet[LCD_MIRROR_HEADER + length] = -sum;
+  return LCD_MIRROR_HEADER + length + 1;
 }
 
-// There is a buffer in RAM that holds one screen
-// This routine clears this buffer
-void Nokia5110_ClearBuffer(void)
+//********UART0_Handler*****************
+// Keep the UART0 transmit FIFO topped up with the mirror packet,
+// and once all of it has been written encode the next packet if
+// the emulator window has changed. Any byte received asks for a
+// key frame.
+// inputs: none
+// outputs: none
+void UART0_Handler(void)
 {
-	int i;
-  for(i=0; i<SCREENW*SCREENH/8; i++)
-    Screen[i] = 0;              // clear buffer
+  UART0_ICR_R = UART_ICR_TXIC|UART_ICR_RXIC|UART_ICR_RTIC;
+  while ( !(UART0_FR_R & UART_FR_RXFE) )
+  {
+    (void)UART0_DR_R;
+    LCD_mirror_key = 1;
+    LCD_mirror_changed = 1;
+  }
+  for (;;)
+  {
+    while ( LCD_mirror_sent < LCD_mirror_length )
+    {
+      if ( UART0_FR_R & UART_FR_TXFF )
+        return; // back again when the FIFO is nearly empty
+      UART0_DR_R = LCD_mirror_packet[LCD_mirror_sent++];
+    }
+    if ( !LCD_mirror_changed )
+      return;
+    LCD_mirror_changed = 0;
+    LCD_mirror_length = LCD_mirror_encode();
+    LCD_mirror_sent = 0;
+  }
 }
 
-//********Nokia5110_DisplayBuffer*****************
-// Fill the whole screen by drawing a 84x48 screen image.
+//********Nokia5110Emu_MirrorRefresh*****************
+// Send the whole emulator window as the next mirror packet, so a
+// viewer which has just started or lost a packet catches up.
 // inputs: none
 // outputs: none
-// assumes: LCD is in default horizontal addressing mode (V = 0)
-void Nokia5110_DisplayBuffer(void)
+void Nokia5110Emu_MirrorRefresh(void)
+{
+  LCD_mirror_key = 1;
+  LCD_MIRROR_KICK();
+}
+#endif
+
+#if NOKIA5110EMU_BENCHMARK
+//============================================================================
+//
+//  Benchmark harness
+//  Call Nokia5110Emu_Benchmark() from main after Nokia5110_Init(). Each entry
+//  point and workload is run NOKIA5110EMU_BENCH_ITERATIONS times, the results
+//  are left in Nokia5110Emu_Bench for the debugger and shown on the LCD.
+//  With uDMA the time until the transfer has finished is measured. Each shape
+//  with a streaming kernel is also sent with LCD_stream_region, so the cycles
+//  per pixel of the two can be compared.
+//  With NOKIA5110EMU_BUFFERED_TEXT the OutChr, Clear and Text entries only
+//  draw into Screen, so they measure buffered composition and send nothing.
+//
+
+struct Nokia5110Emu_BenchResult
+{
+  const char *name;
+  uint32_t min;      // fewest cycles for one call
+  uint32_t mean;     // average cycles for one call
+  uint32_t max;      // most cycles for one call
+  uint32_t systick;  // average SysTick counts for one call, should match mean
+  uint32_t fps;      // calls per second at SYSTEM_CLOCK_HZ
+  uint32_t pixels;   // pixels sent by one call, 0 if it varies
+  uint32_t cpp;      // average cycles per pixel sent, in tenths
+};
+#define LCD_BENCH_RESULTS 14
+#define LCD_BENCH_PAGES   ((LCD_BENCH_RESULTS + 5)/6)
+struct Nokia5110Emu_BenchResult Nokia5110Emu_Bench[LCD_BENCH_RESULTS];
+
+// 16x8 pixel 4-bit BMP with a solid border used as the benchmark sprite
+static unsigned char LCD_bench_sprite[0x76 + 8*8];
+static char LCD_bench_image[2][SCREENW*SCREENH/8] __attribute__ ((aligned(4)));
+
+static void LCD_bench_outchar(int i)
+{
+  Nokia5110_OutChar('A' + i%26);
+}
+
+static void LCD_bench_fullimage(int i)
+{
+  Nokia5110_DrawFullImage(LCD_bench_image[i&1]);
+}
+
+static void LCD_bench_displaybuffer(int i)
+{
+  // every pixel changes so the whole window is sent
+  int j;
+  for (j = 0; j < SCREENW*SCREENH/8; j++)
+    Screen[j] = LCD_bench_image[i&1][j];
+  Nokia5110_DisplayBuffer();
+}
+
+static void LCD_bench_printbmp(int i)
+{
+  Nokia5110_PrintBMP(i%(SCREENW-16), SCREENH-1, LCD_bench_sprite, 0);
+}
+
+static void LCD_bench_clear(int i)
+{
+  (void)i;
+  Nokia5110_Clear();
+}
+
+static void LCD_bench_textscreen(int i)
+{
+  int row;
+  for (row = 0; row < SCREENH/CHAR_HEIGHT; row++)
+  {
+    Nokia5110_SetCursor(0, row);
+    Nokia5110_OutString((i&1) ? "0123456789AB" : "abcdefghijkl");
+  }
+}
+
+static void LCD_bench_sprites(int i)
+{
+  // ten sprites moving one pixel per frame, like a Space Invaders scene
+  int k;
+  Nokia5110_ClearBuffer();
+  for (k = 0; k < 10; k++)
+    Nokia5110_PrintBMP((k%5)*16 + i%4, 8 + (k/5)*20 + i%8, LCD_bench_sprite, 0);
+  Nokia5110_DisplayBuffer();
+}
+
+static void LCD_bench_glyph(int i)
+{
+  LCD_set_window(NOKIA_WINDOW_X, NOKIA_WINDOW_Y, CHAR_WIDTH, CHAR_HEIGHT);
+  LCD_send_region(ASCII6['A' - ' ' + i%26], CHAR_WIDTH);
+}
+
+static void LCD_bench_strip(int i)
+{
+  LCD_set_window(NOKIA_WINDOW_X, NOKIA_WINDOW_Y + i%(NOKIA_MAX_Y/8)*8, NOKIA_MAX_X, 8);
+  LCD_send_region(&LCD_bench_image[i&1][i%(NOKIA_MAX_Y/8)*SCREENW], SCREENW);
+}
+
+static void LCD_bench_frame(int i)
+{
+  LCD_set_window(NOKIA_WINDOW_X, NOKIA_WINDOW_Y, NOKIA_MAX_X, NOKIA_MAX_Y);
+  LCD_send_region(LCD_bench_image[i&1], NOKIA_MAX_X);
+}
+
+//============================================================================
+//
+// Time one benchmark function over NOKIA5110EMU_BENCH_ITERATIONS calls
+// pixels is the number of pixels each call sends, 0 if it varies
+//
+static void LCD_bench_run(struct Nokia5110Emu_BenchResult *result, const char *name, void (*bench)(int),
+                          uint32_t pixels)
+{
+  int i;
+  uint64_t total = 0, ticks = 0;
+  result->name = name;
+  result->min = 0xFFFFFFFF;
+  result->max = 0;
+  for (i = 0; i < NOKIA5110EMU_BENCH_ITERATIONS; i++)
+  {
+    uint32_t cycles, systick = NVIC_ST_CURRENT_R, start = DWT_CYCCNT_R;
+    bench(i);
+#if NOKIA5110EMU_DMA || NOKIA5110EMU_TX_QUEUE
+    Nokia5110Emu_WaitDone();
+#endif
+    cycles = DWT_CYCCNT_R - start;
+    systick = (systick - NVIC_ST_CURRENT_R)&0x00FFFFFF; // SysTick counts down
+    if ( cycles < result->min )
+      result->min = cycles;
+    if ( cycles > result->max )
+      result->max = cycles;
+    total += cycles;
+    ticks += systick;
+  }
+  result->mean = total/NOKIA5110EMU_BENCH_ITERATIONS;
+  result->systick = ticks/NOKIA5110EMU_BENCH_ITERATIONS;
+  result->fps = result->mean ? SYSTEM_CLOCK_HZ/result->mean : 0;
+  result->pixels = pixels;
+  result->cpp = pixels ? (uint32_t)(total*10/NOKIA5110EMU_BENCH_ITERATIONS/pixels) : 0;
+}
+
+//********Nokia5110Emu_Benchmark*****************
+// Measure the cost of the emulator entry points, some typical
+// workloads and the streaming kernels, then show calls per second
+// for each on the LCD followed by cycles per pixel.
+// SysTick is used free running for the duration of the benchmark
+// so no call being timed may take longer than 0.2s at 80MHz.
+// inputs: none
+// outputs: none
+void Nokia5110Emu_Benchmark(void)
 {
-  Nokia5110_DrawFullImage(Screen);
+  int i, page;
+  uint32_t st_ctrl = NVIC_ST_CTRL_R, st_reload = NVIC_ST_RELOAD_R;
+  struct Nokia5110Emu_BenchResult *r = Nokia5110Emu_Bench;
+
+  // Start the cycle counter and a free running SysTick on the core clock
+  DEMCR_R |= DEMCR_TRCENA;
+  DWT_CYCCNT_R = 0;
+  DWT_CTRL_R |= DWT_CTRL_CYCCNTENA;
+  NVIC_ST_CTRL_R = 0;
+  NVIC_ST_RELOAD_R = 0x00FFFFFF;
+  NVIC_ST_CURRENT_R = 0;
+  NVIC_ST_CTRL_R = NVIC_ST_CTRL_ENABLE|NVIC_ST_CTRL_CLK_SRC;
+
+  // Test data: a bordered sprite and two complementary test images
+  LCD_bench_sprite[10] = 0x76;  // offset of image data
+  LCD_bench_sprite[18] = 16;    // width
+  LCD_bench_sprite[22] = 8;     // height
+  for (i = 0; i < 8*8; i++)
+  {
+    if ( i < 8 || i >= 56 )
+      LCD_bench_sprite[0x76 + i] = 0xFF; // top and bottom rows
+    else if ( i%8 == 0 )
+      LCD_bench_sprite[0x76 + i] = 0xF0; // left column
+    else if ( i%8 == 7 )
+      LCD_bench_sprite[0x76 + i] = 0x0F; // right column
+  }
+  for (i = 0; i < SCREENW*SCREENH/8; i++)
+  {
+    LCD_bench_image[0][i] = (i&1) ? 0x55 : 0xAA;
+    LCD_bench_image[1][i] = ~LCD_bench_image[0][i];
+  }
+
+  // Entry points
+  LCD_bench_run(r++, "OutChr", LCD_bench_outchar, CHAR_WIDTH*CHAR_HEIGHT);
+  LCD_bench_run(r++, "FulImg", LCD_bench_fullimage, LCD_VIEW_W*LCD_VIEW_H);
+  LCD_bench_run(r++, "DspBuf", LCD_bench_displaybuffer, LCD_VIEW_W*LCD_VIEW_H);
+  LCD_bench_run(r++, "PrtBMP", LCD_bench_printbmp, 0);
+  LCD_bench_run(r++, "Clear ", LCD_bench_clear, LCD_VIEW_W*LCD_VIEW_H);
+  // Workloads
+  LCD_bench_run(r++, "Text  ", LCD_bench_textscreen, LCD_VIEW_W*LCD_VIEW_H);
+  LCD_bench_run(r++, "Image ", LCD_bench_fullimage, LCD_VIEW_W*LCD_VIEW_H);
+  LCD_bench_run(r++, "Sprite", LCD_bench_sprites, 0);
+  // Streaming kernels against the generic loop for the same shape
+  LCD_bench_generic = 1;
+  LCD_bench_run(r++, "GlyGen", LCD_bench_glyph, CHAR_WIDTH*CHAR_HEIGHT);
+  LCD_bench_run(r++, "StrGen", LCD_bench_strip, NOKIA_MAX_X*8);
+  LCD_bench_run(r++, "FrmGen", LCD_bench_frame, NOKIA_MAX_X*NOKIA_MAX_Y);
+  LCD_bench_generic = 0;
+  LCD_bench_run(r++, "GlyKrn", LCD_bench_glyph, CHAR_WIDTH*CHAR_HEIGHT);
+  LCD_bench_run(r++, "StrKrn", LCD_bench_strip, NOKIA_MAX_X*8);
+  LCD_bench_run(r++, "FrmKrn", LCD_bench_frame, NOKIA_MAX_X*NOKIA_MAX_Y);
+
+  // Restore SysTick for the application
+  NVIC_ST_CTRL_R = 0;
+  NVIC_ST_RELOAD_R = st_reload;
+  NVIC_ST_CURRENT_R = 0;
+  NVIC_ST_CTRL_R = st_ctrl;
+
+#if NOKIA5110EMU_BUFFERED_TEXT
+  // the kernels wrote to the LCD behind the shadow copy's back, so start the
+  // results from a cleared LCD that DisplayBuffer can send changes against
+  Nokia5110Emu_Clear();
+#endif
+  // Show calls per second, then cycles per pixel for the results which
+  // send a known number of pixels, six results per page
+  for (page = 0; page < 2*LCD_BENCH_PAGES; page++)
+  {
+    Nokia5110_Clear();
+    for (i = page%LCD_BENCH_PAGES*6; i < page%LCD_BENCH_PAGES*6 + 6 && i < LCD_BENCH_RESULTS; i++)
+    {
+      const struct Nokia5110Emu_BenchResult *b = &Nokia5110Emu_Bench[i];
+      Nokia5110_SetCursor(0, i%6);
+      Nokia5110_OutString((char *)b->name);
+      if ( page < LCD_BENCH_PAGES )
+        Nokia5110_OutUDec(b->fps > 65535 ? 65535 : b->fps);
+      else if ( b->pixels )
+        Nokia5110Emu_OutFix(b->cpp, 1);
+    }
+#if NOKIA5110EMU_BUFFERED_TEXT
+    // the page was only drawn into Screen
+    Nokia5110_DisplayBuffer();
+#endif
+    delay(3000);
+  }
 }
+#endif
@@ -0,0 +1,158 @@
+// delta_frames.c
+//===========================================================================
+//
+//  Host tool for ST7735.c built with NOKIA5110EMU_DELTA_FRAMES 1
+//  https://github.com/chrislast/Nokia5110Emulator
+//
+//  Description:
+//  Compresses an animation of Nokia5110 frames for Nokia5110Emu_DrawDelta.
+//  Each frame is stored as the XOR of it with the frame before, the first
+//  frame with a cleared screen, coded as runs of unchanged bytes, literal
+//  bytes and repeated bytes. Unchanged runs cost one token so frames which
+//  change little take little flash and are quick to decode.
+//
+//  Input is one or more 504 byte frames laid out like the Nokia5110 display
+//  RAM or the emulator's Screen buffer: 6 banks of 84 bytes, bit 0 of each
+//  byte at the top of its bank. Output is a C source file holding the
+//  frames one after another in a const uint8_t array.
+//
+//  Usage:
+//  cc -o delta_frames delta_frames.c
+//  delta_frames <name> <frames.bin> > frames.c
+//
+//  Then in your project:
+//  extern const uint8_t name[];
+//  const uint8_t *frame = name;
+//  Nokia5110_ClearBuffer();
+//  for ( i = 0 ; i < name_FRAMES ; i++ )
+//    frame = Nokia5110Emu_DrawDelta(frame);
+//
+//============================================================================
+#include <stdio.h>
+#include <stdint.h>
+
+#define SCREENW 84
+#define SCREENH 48
+#define FRAME_BYTES (SCREENW*SCREENH/8)
+
+// Must match the LCD_DELTA_ tokens in ST7735.c
+#define DELTA_COPY  0x80
+#define DELTA_FILL  0xC0
+#define DELTA_SKIP_MAX 128
+#define DELTA_RUN_MAX  64
+// shortest repeat worth a fill run in the middle of literal bytes
+#define DELTA_FILL_MIN 3
+
+static unsigned long frame_bytes; // bytes written for this frame
+static unsigned long all_bytes;
+
+//============================================================================
+//
+// Write one byte of the array, 12 to a line
+//
+static void emit(uint8_t byte)
+{
+  printf("%s0x%02X,%s", frame_bytes%12 ? " " : "  ", byte, frame_bytes%12 == 11 ? "\n" : "");
+  frame_bytes++;
+  all_bytes++;
+}
+
+//============================================================================
+//
+// Number of bytes from d[i] with the same value, up to max
+//
+static int same(const uint8_t *d, int i, int max)
+{
+  int n = 1;
+  while ( i+n < FRAME_BYTES && n < max && d[i+n] == d[i] )
+    n++;
+  return n;
+}
+
+//============================================================================
+//
+// Write the runs for one frame given its XOR with the last frame
+//
+static void encode(const uint8_t *d)
+{
+  int i = 0;
+  while ( i < FRAME_BYTES )
+  {
+    int n = same(d, i, d[i] ? DELTA_RUN_MAX : DELTA_SKIP_MAX);
+    if ( d[i] == 0 )
+    {
+      emit(n-1);
+      i += n;
+    }
+    else if ( n >= DELTA_FILL_MIN )
+    {
+      emit(DELTA_FILL | (n-1));
+      emit(d[i]);
+      i += n;
+    }
+    else
+    {
+      // literal bytes up to the next unchanged byte or worthwhile repeat
+      int start = i;
+      n = 0;
+      while ( i < FRAME_BYTES && n < DELTA_RUN_MAX && d[i] &&
+            ( n == 0 || same(d, i, DELTA_FILL_MIN) < DELTA_FILL_MIN ) )
+      {
+        i++;
+        n++;
+      }
+      emit(DELTA_COPY | (n-1));
+      while ( start < i )
+        emit(d[start++]);
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  uint8_t last[FRAME_BYTES] = {0};
+  uint8_t frame[FRAME_BYTES];
+  uint8_t delta[FRAME_BYTES];
+  unsigned int frames = 0;
+  size_t n;
+  int i;
+  FILE *in;
+
+  if ( argc != 3 )
+  {
+    fprintf(stderr, "usage: %s <name> <frames.bin>\n", argv[0]);
+    return 2;
+  }
+  in = fopen(argv[2], "rb");
+  if ( !in )
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  printf("// %s compressed by delta_frames\n", argv[2]);
+  printf("#include <stdint.h>\n\n");
+  printf("const uint8_t %s[] = {\n", argv[1]);
+  while ( (n = fread(frame, 1, FRAME_BYTES, in)) == FRAME_BYTES )
+  {
+    for ( i = 0 ; i < FRAME_BYTES ; i++ )
+    {
+      delta[i] = frame[i] ^ last[i];
+      last[i] = frame[i];
+    }
+    if ( frame_bytes%12 )
+      printf("\n");
+    printf("  // frame %u\n", frames++);
+    frame_bytes = 0;
+    encode(delta);
+  }
+  fclose(in);
+  printf("%s};\n", frame_bytes%12 ? "\n" : "");
+  printf("const unsigned short %s_FRAMES = %u;\n", argv[1], frames);
+  fprintf(stderr, "%u frames in %lu bytes, %lu uncompressed\n", frames, all_bytes, (unsigned long)frames*FRAME_BYTES);
+  if ( n )
+  {
+    fprintf(stderr, "%s: ignored %u bytes after the last whole frame\n", argv[2], (unsigned int)n);
+    return 1;
+  }
+  return 0;
+}
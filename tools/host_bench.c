@@ -0,0 +1,323 @@
+// host_bench.c
+//===========================================================================
+//
+//  Host tool for ST7735.c built with NOKIA5110EMU_HOST 1
+//  https://github.com/chrislast/Nokia5110Emulator
+//
+//  Description:
+//  Runs the emulator's real drawing code on a PC and measures what it would
+//  send to the ST7735, so changes to it can be checked without a board.
+//  Every SSI2 frame is decoded into a copy of the ST7735 frame memory, and
+//  for each workload the tool reports the bytes sent per call, split into
+//  commands, command parameters and pixel data; the number of RAMWR windows;
+//  and the time the frames take at the SSI2 bit rate. The decoded frame
+//  memory is checked against the emulator's shadow copy of the window after
+//  every workload.
+//
+//  The workload results can be saved and given back as a reference. The
+//  tool then fails if any workload sends more bytes per call than it did.
+//  It exits 0 when every check passes, so it can be run by a CI job.
+//
+//  Other emulator options are set on the command line, as for the target
+//  build. ST7735.c's tm4c123gh6pm.h must be found in the usual place, only
+//  its constants are used.
+//
+//  Usage:
+//  cc -O2 -o host_bench host_bench.c [-DNOKIA5110EMU_SSI_12BIT=1 ...]
+//  host_bench [-s spi_hz] [-n calls] [-r reference.txt] > results.txt
+//
+//============================================================================
+#define NOKIA5110EMU_HOST 1
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "../ST7735.c"
+
+// ST7735 frame memory, 132x162 for the largest panel it drives
+#define GRAM_W 132
+#define GRAM_H 162
+static uint16_t gram[GRAM_H][GRAM_W];
+
+// What the LCD has been sent
+static struct
+{
+  unsigned long command;   // command bytes
+  unsigned long parameter; // command parameter bytes
+  unsigned long pixel_bits;
+  unsigned long windows;   // RAMWR commands
+} sent;
+
+// Command decoder state
+static unsigned int command, count;
+static unsigned int xs, xe, ys, ye, x, y;
+static uint8_t params[4], packed[3];
+
+#if NOKIA5110EMU_SERVER
+// Nothing else runs while the workloads are drawn
+long StartCritical(void) { return 0; }
+void EndCritical(long sr) { (void)sr; }
+void OS_Suspend(void) { }
+#endif
+
+//============================================================================
+//
+// Store one pixel at the RAMWR address and move on through the window
+//
+static void put(uint16_t colour)
+{
+  if ( x < GRAM_W && y < GRAM_H && y <= ye )
+    gram[y][x] = colour;
+  if ( ++x > xe )
+  {
+    x = xs;
+    y++;
+  }
+}
+
+//============================================================================
+//
+// The transport ST7735.c sends every SSI2 frame to
+//
+void Nokia5110Emu_HostWrite(unsigned char rs, unsigned short value, unsigned char bits)
+{
+  if ( !rs )
+  {
+    sent.command++;
+    command = value;
+    count = 0;
+    if ( command == ST7735_RAMWR )
+    {
+      sent.windows++;
+      x = xs;
+      y = ys;
+    }
+    return;
+  }
+  if ( command != ST7735_RAMWR )
+  {
+    sent.parameter++;
+    if ( (command == ST7735_CASET || command == ST7735_RASET) && count < 4 )
+    {
+      params[count++] = value;
+      if ( count == 4 && command == ST7735_CASET )
+      {
+        xs = params[0] << 8 | params[1];
+        xe = params[2] << 8 | params[3];
+      }
+      else if ( count == 4 )
+      {
+        ys = params[0] << 8 | params[1];
+        ye = params[2] << 8 | params[3];
+      }
+    }
+    return;
+  }
+  sent.pixel_bits += bits;
+  if ( bits == 12 )
+    put(value);
+  else
+  {
+    // two 12-bit pixels in every three bytes
+    packed[count++] = value;
+    if ( count == 3 )
+    {
+      put(packed[0] << 4 | packed[1] >> 4);
+      put((packed[1] & 0x0F) << 8 | packed[2]);
+      count = 0;
+    }
+  }
+}
+
+//============================================================================
+//
+// Number of pixels of display 0 in the decoded frame memory which differ
+// from the emulator's shadow copy of it
+//
+static int check_window(void)
+{
+  const struct LCD_context *ctx = &LCD_context[0];
+  int bad = 0, bx, by;
+  for ( by = 0 ; by < LCD_VIEW_H ; by++ )
+    for ( bx = 0 ; bx < LCD_VIEW_W ; bx++ )
+    {
+#if NOKIA5110EMU_UPSCALE
+      // the Nokia pixel each pixel of the scaled window is copied from
+      int col = bx/LCD_SCALE_OUT*LCD_SCALE_IN + LCD_scale_col[bx%LCD_SCALE_OUT];
+      int row = by/LCD_BANK_ROWS*8 + LCD_scale_row[by%LCD_BANK_ROWS];
+#else
+      int col = bx, row = by;
+#endif
+      int on = (ctx->shadow[row/8*SCREENW + col] >> (row%8)) & 1;
+      if ( gram[ctx->y + by + 1][ctx->x + bx + 2] != (on ? PIXEL_ON : PIXEL_OFF) )
+        bad++;
+    }
+  return bad;
+}
+
+//============================================================================
+//
+//  Workloads, each called with the number of the call
+//
+
+static char image[2][SCREENW*SCREENH/8];
+
+static void full_frame(int i)
+{
+  memcpy(Screen, image[i&1], sizeof(Screen));
+  Nokia5110_DisplayBuffer();
+}
+
+static void one_byte(int i)
+{
+  Screen[(i*37)%sizeof(Screen)] ^= 0x81;
+  Nokia5110_DisplayBuffer();
+}
+
+static void full_image(int i)
+{
+  Nokia5110_DrawFullImage(image[i&1]);
+}
+
+static void text_screen(int i)
+{
+  int row;
+  for ( row = 0 ; row < SCREENH/8 ; row++ )
+  {
+    Nokia5110_SetCursor(0, row);
+    Nokia5110_OutString((i&1) ? "0123456789AB" : "abcdefghijkl");
+  }
+#if NOKIA5110EMU_BUFFERED_TEXT
+  Nokia5110_DisplayBuffer();
+#endif
+}
+
+static void out_char(int i)
+{
+  Nokia5110_OutChar('A' + i%26);
+#if NOKIA5110EMU_BUFFERED_TEXT
+  Nokia5110_DisplayBuffer();
+#endif
+}
+
+static void clear(int i)
+{
+  if ( i&1 )
+    Nokia5110_DrawFullImage(image[0]);
+  else
+    Nokia5110_Clear();
+#if NOKIA5110EMU_BUFFERED_TEXT
+  Nokia5110_DisplayBuffer();
+#endif
+}
+
+struct workload
+{
+  const char *name;
+  void (*run)(int i);
+};
+
+static const struct workload workloads[] = {
+  { "displaybuffer_full", full_frame },
+  { "displaybuffer_byte", one_byte },
+  { "drawfullimage", full_image },
+  { "outstring_screen", text_screen },
+  { "outchar", out_char },
+  { "clear_and_image", clear },
+};
+#define WORKLOADS (sizeof(workloads)/sizeof(workloads[0]))
+
+//============================================================================
+//
+// Bytes per call for a workload in a reference file, negative if not there
+//
+static double reference_bytes(const char *file, const char *name)
+{
+  char line[256], found[64];
+  double bytes;
+  FILE *in = fopen(file, "r");
+  if ( !in )
+  {
+    perror(file);
+    exit(2);
+  }
+  while ( fgets(line, sizeof(line), in) )
+    if ( sscanf(line, "%63s %*d %lf", found, &bytes) == 2 && strcmp(found, name) == 0 )
+    {
+      fclose(in);
+      return bytes;
+    }
+  fclose(in);
+  return -1;
+}
+
+int main(int argc, char *argv[])
+{
+  const char *reference = 0;
+  uint32_t spi_hz = 0;
+  int calls = 50, failed = 0, opt, i;
+  size_t w;
+
+  for ( opt = 1 ; opt < argc ; opt++ )
+  {
+    if ( strcmp(argv[opt], "-s") == 0 && opt + 1 < argc )
+      spi_hz = strtoul(argv[++opt], 0, 0);
+    else if ( strcmp(argv[opt], "-n") == 0 && opt + 1 < argc )
+      calls = atoi(argv[++opt]);
+    else if ( strcmp(argv[opt], "-r") == 0 && opt + 1 < argc )
+      reference = argv[++opt];
+    else
+    {
+      fprintf(stderr, "usage: %s [-s spi_hz] [-n calls] [-r reference.txt]\n", argv[0]);
+      return 2;
+    }
+  }
+  if ( calls < 1 )
+    calls = 1;
+  // two images where every pixel differs
+  srand(1);
+  for ( w = 0 ; w < sizeof(image[0]) ; w++ )
+  {
+    image[0][w] = rand();
+    image[1][w] = ~image[0][w];
+  }
+
+  Nokia5110_Init();
+  printf("# init %.1f ms, %lu bytes\n", LCD_host_cycles*1000.0/SYSTEM_CLOCK_HZ,
+         sent.command + sent.parameter + sent.pixel_bits/8);
+  if ( spi_hz )
+    Nokia5110Emu_SetSPIClock(spi_hz);
+  printf("# SSI2 %lu Hz, %d calls per workload\n", (unsigned long)Nokia5110Emu_GetSPIClock(), calls);
+  printf("# %-20s %6s %10s %9s %9s %10s %8s %10s %9s %s\n", "workload", "calls", "bytes/call",
+         "command", "parameter", "pixel", "windows", "us/call", "calls/s", "check");
+
+  for ( w = 0 ; w < WORKLOADS ; w++ )
+  {
+    uint32_t start = LCD_host_cycles;
+    double bytes, us;
+    int bad;
+    memset(&sent, 0, sizeof(sent));
+    for ( i = 0 ; i < calls ; i++ )
+      workloads[w].run(i);
+    bytes = (sent.command + sent.parameter + sent.pixel_bits/8.0)/calls;
+    us = (double)(LCD_host_cycles - start)*1e6/SYSTEM_CLOCK_HZ/calls;
+    bad = check_window();
+    printf("%-22s %6d %10.1f %9.1f %9.1f %10.1f %8.1f %10.1f %9.0f %s\n", workloads[w].name, calls, bytes,
+           (double)sent.command/calls, (double)sent.parameter/calls, sent.pixel_bits/8.0/calls,
+           (double)sent.windows/calls, us, us > 0 ? 1e6/us : 0, bad ? "FAIL" : "ok");
+    if ( bad )
+    {
+      fprintf(stderr, "%s: %d pixels differ from the shadow copy\n", workloads[w].name, bad);
+      failed = 1;
+    }
+    if ( reference )
+    {
+      double was = reference_bytes(reference, workloads[w].name);
+      if ( was >= 0 && bytes > was + 0.05 )
+      {
+        fprintf(stderr, "%s: %.1f bytes per call, %.1f in %s\n", workloads[w].name, bytes, was, reference);
+        failed = 1;
+      }
+    }
+  }
+  return failed;
+}
@@ -0,0 +1,212 @@
+// mirror_view.c
+//===========================================================================
+//
+//  Host tool for ST7735.c built with NOKIA5110EMU_MIRROR 1
+//  https://github.com/chrislast/Nokia5110Emulator
+//
+//  Description:
+//  Shows the emulator window streamed over UART0 by the mirror in a
+//  terminal, two rows of pixels to a line. Each packet holds the runs of
+//  unchanged, literal and repeated bytes described in ST7735.c, XORed into
+//  the picture the viewer holds; a key frame is XORed with a cleared screen.
+//
+//  A packet with a bad checksum or a gap in the sequence numbers leaves the
+//  picture out of date, so deltas are ignored until the next key frame. When
+//  the input is a serial port a byte is sent to ask for one, both at the start
+//  and after an error. Input is either the serial port itself or a raw capture
+//  of it.
+//
+//  With -o every picture shown is also written to a file as a 504 byte frame
+//  laid out like the Screen buffer, which tools/delta_frames.c can read.
+//  With -q only the last picture is shown, after the totals.
+//
+//  Usage:
+//  cc -o mirror_view mirror_view.c
+//  stty -F /dev/ttyACM0 115200 raw
+//  mirror_view [-q] [-o frames.bin] /dev/ttyACM0
+//
+//============================================================================
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <unistd.h>
+
+#define SCREENW 84
+#define SCREENH 48
+#define FRAME_BYTES (SCREENW*SCREENH/8)
+
+// Must match the packets and LCD_DELTA_ tokens in ST7735.c
+#define MIRROR_SYNC    0xA5
+#define MIRROR_HEADER  5
+#define MIRROR_RUNS_MAX (FRAME_BYTES*3/2)
+#define DELTA_COPY  0x80
+#define DELTA_FILL  0xC0
+#define DELTA_SKIP_M 0x7F
+#define DELTA_RUN_M  0x3F
+
+static uint8_t screen[FRAME_BYTES];
+static FILE *port_out; // the serial port, to ask for key frames
+
+//============================================================================
+//
+// Ask the mirror for a key frame
+//
+static void request_key(void)
+{
+  if ( port_out )
+  {
+    putc(0, port_out);
+    fflush(port_out);
+  }
+}
+
+//============================================================================
+//
+// Draw the picture, the top and bottom pixel of each character cell from
+// two rows in a bank
+//
+static void show(void)
+{
+  static const char *cell[4] = { " ", "\xE2\x96\x80", "\xE2\x96\x84", "\xE2\x96\x88" };
+  int row, col;
+  printf("\033[H");
+  for ( row = 0 ; row < SCREENH ; row += 2 )
+  {
+    for ( col = 0 ; col < SCREENW ; col++ )
+    {
+      uint8_t bank = screen[row/8*SCREENW + col];
+      printf("%s", cell[(bank >> (row%8) & 1) | (bank >> (row%8 + 1) & 1) << 1]);
+    }
+    printf("\n");
+  }
+  fflush(stdout);
+}
+
+//============================================================================
+//
+// XOR the runs of one packet into the picture, 0 if they run off the end
+//
+static int apply(const uint8_t *runs, unsigned int length)
+{
+  unsigned int i = 0, k = 0;
+  while ( k < length )
+  {
+    uint8_t token = runs[k++];
+    unsigned int count = (token < DELTA_COPY ? (token & DELTA_SKIP_M) : (token & DELTA_RUN_M)) + 1;
+    if ( i + count > FRAME_BYTES )
+      return 0;
+    if ( token >= DELTA_FILL )
+    {
+      if ( k >= length )
+        return 0;
+      while ( count-- )
+        screen[i++] ^= runs[k];
+      k++;
+    }
+    else if ( token >= DELTA_COPY )
+    {
+      if ( k + count > length )
+        return 0;
+      while ( count-- )
+        screen[i++] ^= runs[k++];
+    }
+    else
+      i += count;
+  }
+  return 1;
+}
+
+int main(int argc, char *argv[])
+{
+  uint8_t header[MIRROR_HEADER], runs[MIRROR_RUNS_MAX + 1];
+  unsigned long packets = 0, keys = 0, errors = 0, bytes = 0;
+  unsigned int length, i;
+  int quiet = 0, synced = 0, sequence = -1, usage = 0, c, opt;
+  const char *port = 0, *output = 0;
+  FILE *in, *out = 0;
+  uint8_t sum;
+
+  for ( opt = 1 ; opt < argc ; opt++ )
+  {
+    if ( strcmp(argv[opt], "-q") == 0 )
+      quiet = 1;
+    else if ( strcmp(argv[opt], "-o") == 0 && opt + 1 < argc )
+      output = argv[++opt];
+    else if ( !port && argv[opt][0] != '-' )
+      port = argv[opt];
+    else
+      usage = 1;
+  }
+  if ( usage || !port )
+  {
+    fprintf(stderr, "usage: %s [-q] [-o frames.bin] <port|capture>\n", argv[0]);
+    return 2;
+  }
+  in = fopen(port, "rb");
+  if ( !in )
+  {
+    perror(port);
+    return 1;
+  }
+  // a serial port can be asked for a key frame, a capture is only read
+  if ( isatty(fileno(in)) )
+    port_out = fopen(port, "wb");
+  if ( output && !(out = fopen(output, "wb")) )
+  {
+    perror(output);
+    return 1;
+  }
+  if ( !quiet )
+    printf("\033[2J");
+  request_key();
+
+  while ( (c = getc(in)) != EOF )
+  {
+    if ( c != MIRROR_SYNC )
+      continue;
+    if ( fread(header + 1, 1, MIRROR_HEADER - 1, in) != MIRROR_HEADER - 1 )
+      break;
+    length = header[3] | header[4] << 8;
+    if ( (header[1] != 'K' && header[1] != 'D') || length > MIRROR_RUNS_MAX )
+      continue; // not a packet, find the next sync byte
+    if ( fread(runs, 1, length + 1, in) != length + 1 )
+      break;
+    for ( sum = 0, i = 1 ; i < MIRROR_HEADER ; i++ )
+      sum += header[i];
+    for ( i = 0 ; i <= length ; i++ )
+      sum += runs[i];
+    bytes += MIRROR_HEADER + length + 1;
+    if ( header[1] == 'K' )
+    {
+      memset(screen, 0, sizeof(screen));
+      synced = 1;
+    }
+    else if ( sequence < 0 || header[2] != (uint8_t)(sequence + 1) )
+      synced = 0;
+    sequence = header[2];
+    if ( sum || !apply(runs, length) )
+      synced = 0;
+    if ( !synced )
+    {
+      // the picture is out of date until a key frame arrives
+      errors++;
+      request_key();
+      continue;
+    }
+    packets++;
+    keys += header[1] == 'K';
+    if ( out )
+      fwrite(screen, 1, sizeof(screen), out);
+    if ( !quiet )
+      show();
+  }
+  fclose(in);
+  if ( port_out )
+    fclose(port_out);
+  if ( out )
+    fclose(out);
+  fprintf(stderr, "%lu packets, %lu key frames, %lu bytes, %lu errors\n", packets, keys, bytes, errors);
+  if ( quiet && packets )
+    show();
+  return 0;
+}
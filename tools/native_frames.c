@@ -0,0 +1,106 @@
+// native_frames.c
+//===========================================================================
+//
+//  Host tool for ST7735.c built with NOKIA5110EMU_NATIVE_FRAMES 1
+//  https://github.com/chrislast/Nokia5110Emulator
+//
+//  Description:
+//  Converts Nokia5110 frames into the 12-bit format the ST7735 is sent by
+//  the emulator so Nokia5110Emu_DrawNative can copy them from flash to the
+//  LCD without expanding each pixel.
+//
+//  Input is one or more 504 byte frames laid out like the Nokia5110 display
+//  RAM or the emulator's Screen buffer: 6 banks of 84 bytes, bit 0 of each
+//  byte at the top of its bank. Output is a C source file holding a
+//  const uint8_t array of NOKIA5110EMU_NATIVE_BYTES (6048) bytes per frame.
+//
+//  Usage:
+//  cc -o native_frames native_frames.c
+//  native_frames <name> <frames.bin> > frames.c
+//
+//  Then in your project:
+//  extern const uint8_t name[];
+//  Nokia5110Emu_PlayNative(name, 0, name_FRAMES, 10);
+//
+//============================================================================
+#include <stdio.h>
+#include <stdint.h>
+
+#define SCREENW 84
+#define SCREENH 48
+#define FRAME_BYTES (SCREENW*SCREENH/8)
+#define NATIVE_BYTES (SCREENW*SCREENH*3/2)
+
+// Must match PIXEL_ON and PIXEL_OFF in ST7735.c
+#define PIXEL_ON   (0x0000)  // Black
+#define PIXEL_OFF  (0x0FFF)  // White
+
+//============================================================================
+//
+// Pixel colour at (x, y) of a Nokia5110 frame
+//
+static unsigned int pixel(const uint8_t *frame, int x, int y)
+{
+  return (frame[(y/8)*SCREENW + x] >> (y%8)) & 1 ? PIXEL_ON : PIXEL_OFF;
+}
+
+//============================================================================
+//
+// Write one frame as rows of pixel pairs, 3 bytes for each pair
+//
+static void convert(const uint8_t *frame, uint8_t *native)
+{
+  int x, y;
+  for ( y = 0 ; y < SCREENH ; y++ )
+  {
+    for ( x = 0 ; x < SCREENW ; x += 2 )
+    {
+      unsigned int p1 = pixel(frame, x, y);
+      unsigned int p2 = pixel(frame, x+1, y);
+      *native++ = (p1 & 0x0FF0) >> 4;
+      *native++ = ((p1 & 0x000F) << 4) | ((p2 & 0x0F00) >> 8);
+      *native++ = p2 & 0x00FF;
+    }
+  }
+}
+
+int main(int argc, char *argv[])
+{
+  uint8_t frame[FRAME_BYTES];
+  uint8_t native[NATIVE_BYTES];
+  unsigned int frames = 0;
+  size_t n;
+  int i;
+  FILE *in;
+
+  if ( argc != 3 )
+  {
+    fprintf(stderr, "usage: %s <name> <frames.bin>\n", argv[0]);
+    return 2;
+  }
+  in = fopen(argv[2], "rb");
+  if ( !in )
+  {
+    perror(argv[2]);
+    return 1;
+  }
+  printf("// %s converted by native_frames\n", argv[2]);
+  printf("#include <stdint.h>\n\n");
+  printf("const uint8_t %s[] = {\n", argv[1]);
+  while ( (n = fread(frame, 1, FRAME_BYTES, in)) == FRAME_BYTES )
+  {
+    convert(frame, native);
+    printf("  // frame %u\n", frames++);
+    for ( i = 0 ; i < NATIVE_BYTES ; i++ )
+      printf("%s0x%02X,%s", i%12 ? " " : "  ", native[i], i%12 == 11 ? "\n" : "");
+  }
+  fclose(in);
+  printf("};\n");
+  printf("const unsigned short %s_FRAMES = %u;\n", argv[1], frames);
+  if ( n )
+  {
+    fprintf(stderr, "%s: ignored %u bytes after the last whole frame\n", argv[2], (unsigned int)n);
+    return 1;
+  }
+  return 0;
+}
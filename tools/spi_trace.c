@@ -0,0 +1,188 @@
+// spi_trace.c
+//===========================================================================
+//
+//  Host tool for ST7735.c built with NOKIA5110EMU_TRACE 1
+//  https://github.com/chrislast/Nokia5110Emulator
+//
+//  Description:
+//  Lists the SPI transactions sent by Nokia5110Emu_TraceDump over UART0 and
+//  totals them, so the bytes and time behind a slow frame can be seen: the
+//  command overhead of many small windows, more pixel data than the change
+//  needed, or time spent waiting for the SSI.
+//
+//  Input is a raw capture of the UART0 output, anything before the "ST7T"
+//  header is skipped. Each transaction is listed with its time since the
+//  first one, followed by the totals for each type, for each Nokia5110Emu_-
+//  TraceMark tag and for each window size.
+//
+//  Usage:
+//  cc -o spi_trace spi_trace.c
+//  stty -F /dev/ttyACM0 115200 raw; cat /dev/ttyACM0 > trace.bin
+//  spi_trace trace.bin
+//
+//============================================================================
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+
+// Must match the LCD_TRACE_ types in ST7735.c
+#define TRACE_COMMAND 0
+#define TRACE_WINDOW  1
+#define TRACE_DATA    2
+#define TRACE_MARK    3
+#define TRACE_TYPES   4
+#define ENTRY_BYTES   16
+// distinct window sizes totalled
+#define SIZES 64
+
+static const char *type_name[TRACE_TYPES] = { "command", "window", "data", "mark" };
+
+struct total
+{
+  unsigned long count;
+  unsigned long bytes;
+  unsigned long wait;
+};
+
+//============================================================================
+//
+// Little endian value of n bytes
+//
+static uint32_t get(const uint8_t *p, int n)
+{
+  uint32_t value = 0;
+  while ( n-- )
+    value = value << 8 | p[n];
+  return value;
+}
+
+//============================================================================
+//
+// Add one transaction to a total
+//
+static void add(struct total *t, uint32_t bytes, uint32_t wait)
+{
+  t->count++;
+  t->bytes += bytes;
+  t->wait += wait;
+}
+
+static void print_total(const char *name, const struct total *t, double us_per_cycle)
+{
+  printf("  %-12s %8lu %10lu %12.1f\n", name, t->count, t->bytes, t->wait*us_per_cycle);
+}
+
+int main(int argc, char *argv[])
+{
+  struct total types[TRACE_TYPES] = {{0}};
+  struct total marks[256] = {{0}};
+  struct total sizes[SIZES] = {{0}};
+  unsigned int size_w[SIZES], size_h[SIZES];
+  int mark_seen[256] = {0};
+  unsigned int sizes_used = 0;
+  int tag = -1;
+  uint8_t header[16], entry[ENTRY_BYTES];
+  uint32_t count, recorded, clock_hz, first = 0, i;
+  double us_per_cycle;
+  int c, matched = 0;
+  FILE *in;
+
+  if ( argc != 2 )
+  {
+    fprintf(stderr, "usage: %s <trace.bin>\n", argv[0]);
+    return 2;
+  }
+  in = fopen(argv[1], "rb");
+  if ( !in )
+  {
+    perror(argv[1]);
+    return 1;
+  }
+  // find the header
+  while ( matched < 4 && (c = getc(in)) != EOF )
+    matched = c == "ST7T"[matched] ? matched + 1 : c == 'S';
+  memcpy(header, "ST7T", 4);
+  if ( matched < 4 || fread(&header[4], 1, 12, in) != 12 )
+  {
+    fprintf(stderr, "%s: no trace found\n", argv[1]);
+    return 1;
+  }
+  if ( header[4] != 1 || header[5] != ENTRY_BYTES )
+  {
+    fprintf(stderr, "%s: trace version %u with %u byte entries not supported\n", argv[1], header[4], header[5]);
+    return 1;
+  }
+  count = get(&header[6], 2);
+  recorded = get(&header[8], 4);
+  clock_hz = get(&header[12], 4);
+  us_per_cycle = 1e6/clock_hz;
+  printf("%lu transactions, %lu older ones lost, %lu Hz clock\n",
+         (unsigned long)count, (unsigned long)(recorded - count), (unsigned long)clock_hz);
+  printf("%12s %-8s %4s %15s %6s %10s\n", "time us", "type", "code", "window", "bytes", "wait us");
+
+  for ( i = 0 ; i < count ; i++ )
+  {
+    uint32_t time, wait, bytes;
+    unsigned int type, code, j;
+    if ( fread(entry, 1, ENTRY_BYTES, in) != ENTRY_BYTES )
+    {
+      fprintf(stderr, "%s: trace ends after %lu of %lu transactions\n", argv[1], (unsigned long)i, (unsigned long)count);
+      break;
+    }
+    time = get(&entry[0], 4);
+    wait = get(&entry[4], 4);
+    bytes = get(&entry[8], 2);
+    type = entry[10];
+    code = entry[11];
+    if ( i == 0 )
+      first = time;
+    printf("%12.1f %-8s 0x%02X %3u,%3u %3ux%-3u %6lu %10.1f\n", (uint32_t)(time - first)*us_per_cycle,
+           type < TRACE_TYPES ? type_name[type] : "?", code, entry[12], entry[13], entry[14], entry[15],
+           (unsigned long)bytes, wait*us_per_cycle);
+    if ( type >= TRACE_TYPES )
+      continue;
+    add(&types[type], bytes, wait);
+    if ( type == TRACE_MARK )
+    {
+      tag = code;
+      mark_seen[tag] = 1;
+      continue;
+    }
+    if ( tag >= 0 )
+      add(&marks[tag], bytes, wait);
+    if ( type == TRACE_WINDOW || type == TRACE_DATA )
+    {
+      // windows opened and pixel data sent for each size of window
+      for ( j = 0 ; j < sizes_used && (size_w[j] != entry[14] || size_h[j] != entry[15]) ; j++ ) {};
+      if ( j == sizes_used && sizes_used < SIZES )
+      {
+        size_w[j] = entry[14];
+        size_h[j] = entry[15];
+        sizes_used++;
+      }
+      if ( j < sizes_used )
+        add(&sizes[j], bytes, wait);
+    }
+  }
+  fclose(in);
+
+  printf("\n  %-12s %8s %10s %12s\n", "type", "count", "bytes", "wait us");
+  for ( c = 0 ; c < TRACE_TYPES ; c++ )
+    print_total(type_name[c], &types[c], us_per_cycle);
+  printf("\n  %-12s %8s %10s %12s\n", "after mark", "count", "bytes", "wait us");
+  for ( c = 0 ; c < 256 ; c++ )
+    if ( mark_seen[c] )
+    {
+      char name[8];
+      sprintf(name, "0x%02X", c);
+      print_total(name, &marks[c], us_per_cycle);
+    }
+  printf("\n  %-12s %8s %10s %12s\n", "window", "count", "bytes", "wait us");
+  for ( c = 0 ; c < (int)sizes_used ; c++ )
+  {
+    char name[16];
+    sprintf(name, "%ux%u", size_w[c], size_h[c]);
+    print_total(name, &sizes[c], us_per_cycle);
+  }
+  return 0;
+}